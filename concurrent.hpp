@@ -0,0 +1,327 @@
+#ifndef CONCURRENT_HPP
+#define CONCURRENT_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "containers.hpp"
+
+namespace containers {
+    /* Concurrent container */
+
+    // Copy-on-write container for many readers and few writers. Readers grab the current version in O(1) and
+    // walk any order of it without locks or copies; writers are serialized, change a private copy of the
+    // elements and publish it as the next version. A version lives as long as a snapshot holds it.
+    //
+    // High-rate ingestion goes through ingest() or a per-thread Producer instead: appends are buffered per
+    // thread, pushed lock-free onto a pending stack a batch at a time and folded into the next version.
+    template<typename T>
+    class ConcurrentContainer {
+        struct Version {
+            View<T> elements;
+            Parallelism parallelism;
+            mutable std::once_flag sorting;
+            mutable View<T> sorted;
+
+            // sorted once per version, by whichever reader asks first
+            const View<T> &sorted_view() const {
+                std::call_once(sorting, [this] { sorted = detail::sorted_copy(*elements, parallelism); });
+                return sorted;
+            }
+        };
+
+        std::atomic<std::shared_ptr<const Version>> current;
+        std::mutex writers;
+        Parallelism parallelism;
+
+        // appended elements waiting for the next fold, newest batch first
+        struct Batch {
+            std::vector<T> items;
+            Batch *next = nullptr;
+        };
+
+        std::atomic<Batch *> pending{nullptr};
+        std::atomic<size_t> pending_count{0};
+        std::atomic<size_t> min_fold{1 << 16};
+
+        // The ingest() buffer of one thread. Only its thread appends, so the flag is uncontended but for the
+        // moments a fold takes the buffered elements.
+        struct Segment {
+            std::atomic_flag busy;
+            std::thread::id thread;
+            std::vector<T> items;
+            Segment *next = nullptr;
+
+            void lock() {
+                while (busy.test_and_set(std::memory_order_acquire)) busy.wait(true, std::memory_order_relaxed);
+            }
+
+            void unlock() {
+                busy.clear(std::memory_order_release);
+                busy.notify_one();
+            }
+        };
+
+        static constexpr size_t segment_batch = 1 << 10;
+        const uint64_t id = next_id++; // tells containers apart in the per-thread cache, addresses get reused
+        std::atomic<Segment *> segments{nullptr};
+
+        static inline std::atomic<uint64_t> next_id{1};
+
+        // the calling thread's segment, made on its first ingest()
+        Segment &local_segment() {
+            thread_local struct {
+                uint64_t owner = 0;
+                Segment *segment = nullptr;
+            } cached;
+            if (cached.owner == id) return *cached.segment;
+            const auto self = std::this_thread::get_id();
+            Segment *found = segments.load(std::memory_order_acquire);
+            while (found && found->thread != self) found = found->next;
+            if (!found) {
+                found = new Segment;
+                found->thread = self;
+                found->items.reserve(segment_batch);
+                found->next = segments.load(std::memory_order_relaxed);
+                while (!segments.compare_exchange_weak(found->next, found, std::memory_order_release,
+                                                       std::memory_order_relaxed)) {}
+            }
+            cached = {id, found};
+            return *found;
+        }
+
+        void push(std::vector<T> &&items) { fold_if_due(stack(std::move(items))); }
+
+        // puts a batch on the pending stack, returns the backlog
+        size_t stack(std::vector<T> &&items) {
+            const size_t n = items.size();
+            auto *batch = new Batch{std::move(items)};
+            batch->next = pending.load(std::memory_order_relaxed);
+            while (!pending.compare_exchange_weak(batch->next, batch, std::memory_order_release,
+                                                  std::memory_order_relaxed)) {}
+            return pending_count.fetch_add(n, std::memory_order_relaxed) + n;
+        }
+
+        // folds copy the elements, so they wait for a backlog proportional to the size (amortized O(1))
+        void fold_if_due(const size_t backlog) {
+            if (backlog >= std::max(min_fold.load(std::memory_order_relaxed), size() / 4)) {
+                std::unique_lock lock(writers, std::try_to_lock);
+                if (lock) fold();
+            }
+        }
+
+        // caller holds the writers lock; takes the pending batches, then what the segments buffer
+        size_t fold() {
+            Batch *batch = pending.exchange(nullptr, std::memory_order_acquire);
+            Batch *oldest = nullptr;
+            size_t n = 0, buffered = 0;
+            while (batch) {
+                n += batch->items.size();
+                oldest = std::exchange(batch, std::exchange(batch->next, oldest));
+            }
+            std::vector<std::vector<T>> taken;
+            for (Segment *s = segments.load(std::memory_order_acquire); s; s = s->next) {
+                s->lock();
+                if (!s->items.empty()) {
+                    buffered += s->items.size();
+                    taken.push_back(std::exchange(s->items, {}));
+                }
+                s->unlock();
+            }
+            if (!n && !buffered) return 0;
+            const auto &elements = *current.load()->elements;
+            auto next = std::make_shared<std::vector<T>>();
+            next->reserve(elements.size() + n + buffered);
+            next->insert(next->end(), elements.begin(), elements.end());
+            while (oldest) {
+                std::move(oldest->items.begin(), oldest->items.end(), std::back_inserter(*next));
+                delete std::exchange(oldest, oldest->next);
+            }
+            for (auto &items: taken) std::move(items.begin(), items.end(), std::back_inserter(*next));
+            pending_count.fetch_sub(n, std::memory_order_relaxed);
+            publish(std::move(next));
+            return n + buffered;
+        }
+
+        void publish(View<T> elements) {
+            auto next = std::make_shared<Version>();
+            next->elements = std::move(elements);
+            next->parallelism = parallelism;
+            current.store(std::move(next));
+        }
+
+    public:
+        using Order = typename MyContainer<T>::Order;
+        using ReverseOrder = typename MyContainer<T>::ReverseOrder;
+        using AscendingOrder = typename MyContainer<T>::AscendingOrder;
+        using DescendingOrder = typename MyContainer<T>::DescendingOrder;
+        using SideCrossOrder = typename MyContainer<T>::SideCrossOrder;
+        using MiddleOutOrder = typename MyContainer<T>::MiddleOutOrder;
+
+        // immutable version of the container
+        class Snapshot {
+            friend class ConcurrentContainer;
+
+            std::shared_ptr<const Version> version;
+
+            explicit Snapshot(std::shared_ptr<const Version> version) : version(std::move(version)) {}
+
+        public:
+            size_t size() const { return version->elements->size(); }
+
+            const T &operator[](const size_t index) const {
+                if (index >= size()) throw std::runtime_error("Index out of range");
+                return (*version->elements)[index];
+            }
+
+            const View<T> &elements() const { return version->elements; }
+
+            Order begin_order() const { return at_begin(Order(version->elements)); }
+            Order end_order() const { return at_end(Order(version->elements)); }
+
+            ReverseOrder begin_reverse_order() const { return at_begin(ReverseOrder(version->elements)); }
+            ReverseOrder end_reverse_order() const { return at_end(ReverseOrder(version->elements)); }
+
+            AscendingOrder begin_ascending_order() const { return at_begin(AscendingOrder(version->sorted_view())); }
+            AscendingOrder end_ascending_order() const { return at_end(AscendingOrder(version->sorted_view())); }
+
+            DescendingOrder begin_descending_order() const {
+                return at_begin(DescendingOrder(version->sorted_view()));
+            }
+
+            DescendingOrder end_descending_order() const { return at_end(DescendingOrder(version->sorted_view())); }
+
+            SideCrossOrder begin_side_cross_order() const { return at_begin(SideCrossOrder(version->sorted_view())); }
+            SideCrossOrder end_side_cross_order() const { return at_end(SideCrossOrder(version->sorted_view())); }
+
+            MiddleOutOrder begin_middle_out_order() const {
+                return at_begin(MiddleOutOrder(version->sorted_view()));
+            }
+
+            MiddleOutOrder end_middle_out_order() const { return at_end(MiddleOutOrder(version->sorted_view())); }
+        };
+
+        // Single-thread append handle: buffers appends locally and hands them over one batch at a time, so an
+        // add is a push_back plus, once per batch, one CAS. Must not outlive its container.
+        class Producer {
+            friend class ConcurrentContainer;
+
+            ConcurrentContainer *owner;
+            size_t capacity;
+            std::vector<T> batch;
+
+            Producer(ConcurrentContainer &owner, const size_t capacity) : owner(&owner), capacity(capacity) {
+                batch.reserve(capacity);
+            }
+
+        public:
+            Producer(Producer &&other) noexcept
+                : owner(std::exchange(other.owner, nullptr)), capacity(other.capacity), batch(std::move(other.batch)) {}
+
+            Producer &operator=(Producer &&) = delete;
+
+            ~Producer() { flush(); }
+
+            void add(const T &value) {
+                batch.push_back(value);
+                if (batch.size() >= capacity) flush();
+            }
+
+            // hands the buffered appends over to the container
+            void flush() {
+                if (!owner || batch.empty()) return;
+                owner->push(std::move(batch));
+                batch = {};
+                batch.reserve(capacity);
+            }
+        };
+
+        ConcurrentContainer() { publish(std::make_shared<const std::vector<T>>()); }
+
+        ConcurrentContainer(const ConcurrentContainer &) = delete;
+
+        ConcurrentContainer &operator=(const ConcurrentContainer &) = delete;
+
+        ~ConcurrentContainer() {
+            for (Batch *b = pending.load(); b;) delete std::exchange(b, b->next);
+            for (Segment *s = segments.load(); s;) delete std::exchange(s, s->next);
+        }
+
+        Snapshot snapshot() const { return Snapshot(current.load()); }
+
+        size_t size() const { return current.load()->elements->size(); }
+
+        /* Ingestion (lock-free; visible to readers after the next fold) */
+
+        // Appends from any thread into that thread's buffer, handed over like a Producer's batch once it holds
+        // 1024 elements; folds take what the buffers hold too. A Producer skips the buffer lookup and flag.
+        void ingest(const T &value) {
+            auto &segment = local_segment();
+            segment.lock();
+            segment.items.push_back(value);
+            size_t backlog = 0;
+            // stacked before the flag is released, so a fold cannot take later appends ahead of the batch
+            if (segment.items.size() >= segment_batch) {
+                backlog = stack(std::exchange(segment.items, {}));
+                segment.items.reserve(segment_batch);
+            }
+            segment.unlock();
+            if (backlog) fold_if_due(backlog);
+        }
+
+        Producer producer(const size_t batch = 1 << 10) { return Producer(*this, std::max<size_t>(batch, 1)); }
+
+        // folds every pending append into a new version, returns how many there were
+        size_t flush() {
+            std::lock_guard guard(writers);
+            return fold();
+        }
+
+        // pending appends are folded once they reach max(threshold, size() / 4)
+        void set_fold_threshold(const size_t threshold) { min_fold = threshold; }
+
+        /* Writers (see pending appends first) */
+
+        // Applies fn(std::vector<T> &) to a copy of the current elements and publishes the result as one
+        // version; a fn returning bool publishes only when it returns true. Batch changes through here.
+        template<typename F>
+        void update(F &&fn) {
+            std::lock_guard guard(writers);
+            fold();
+            auto next = std::make_shared<std::vector<T>>(*current.load()->elements);
+            if constexpr (std::is_same_v<std::invoke_result_t<F, std::vector<T> &>, bool>) {
+                if (!fn(*next)) return;
+            } else fn(*next);
+            publish(std::move(next));
+        }
+
+        void add(const T &value) {
+            update([&](std::vector<T> &v) { v.push_back(value); });
+        }
+
+        // removes every occurrence of value, returns how many there were
+        size_t try_remove(const T &value) {
+            size_t removed = 0;
+            update([&](std::vector<T> &v) { return (removed = detail::remove(v, value)) > 0; });
+            return removed;
+        }
+
+        void remove(const T &value) {
+            if (!try_remove(value)) throw std::runtime_error("Value not found in container");
+        }
+
+        // applies to the versions published from now on
+        void set_parallelism(const Parallelism &p) {
+            std::lock_guard guard(writers);
+            parallelism = p;
+        }
+    };
+} // namespace containers
+
+#endif //CONCURRENT_HPP
@@ -4,5 +4,126 @@
 
 #include "containers.hpp"
 
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
 namespace containers {
+    namespace detail {
+        namespace {
+            struct Keyed {
+                uint64_t key;
+                size_t index;
+            };
+
+            // bytes [depth, depth + 8) of s as a big-endian integer, zero padded past the end of s
+            uint64_t key_prefix(const std::string &s, const size_t depth) {
+                uint64_t key = 0;
+                const size_t len = s.size() > depth ? std::min<size_t>(8, s.size() - depth) : 0;
+                for (size_t i = 0; i < len; ++i)
+                    key |= static_cast<uint64_t>(static_cast<unsigned char>(s[depth + i])) << (56 - 8 * i);
+                return key;
+            }
+
+            // LSD radix sort on the keys; byte positions on which every key agrees are skipped
+            void radix_sort(Keyed *k, const size_t n, std::vector<Keyed> &buffer) {
+                buffer.resize(n);
+                Keyed *src = k, *dst = buffer.data();
+                for (unsigned shift = 0; shift < 64; shift += 8) {
+                    size_t offsets[256] = {};
+                    for (size_t i = 0; i < n; ++i) ++offsets[src[i].key >> shift & 0xFF];
+                    if (offsets[src[0].key >> shift & 0xFF] == n) continue;
+                    for (size_t b = 0, sum = 0; b < 256; ++b) sum += std::exchange(offsets[b], sum);
+                    for (size_t i = 0; i < n; ++i) dst[offsets[src[i].key >> shift & 0xFF]++] = src[i];
+                    std::swap(src, dst);
+                }
+                if (src != k) std::copy(src, src + n, k);
+            }
+
+            void sort_prefixed(const std::string *s, Keyed *k, const size_t n, const size_t depth,
+                               std::vector<Keyed> &buffer) {
+                if (n >= 1024) radix_sort(k, n, buffer);
+                else std::sort(k, k + n, [](const Keyed &a, const Keyed &b) { return a.key < b.key; });
+                for (size_t b = 0, e; b < n; b = e) {
+                    for (e = b + 1; e < n && k[e].key == k[b].key;) ++e;
+                    if (e - b < 2) continue;
+                    const bool longer = std::all_of(k + b, k + e, [&](const Keyed &x) {
+                        return s[x.index].size() > depth + 8;
+                    });
+                    if (longer) {
+                        for (size_t i = b; i < e; ++i) k[i].key = key_prefix(s[k[i].index], depth + 8);
+                        sort_prefixed(s, k + b, e - b, depth + 8, buffer);
+                    } else {
+                        std::sort(k + b, k + e, [&](const Keyed &x, const Keyed &y) {
+                            return std::string_view(s[x.index]).substr(depth) <
+                                   std::string_view(s[y.index]).substr(depth);
+                        });
+                    }
+                }
+            }
+        }
+
+        void sort_strings(std::string *first, const size_t n) {
+            std::vector<Keyed> keys(n);
+            for (size_t i = 0; i < n; ++i) keys[i] = {key_prefix(first[i], 0), i};
+            std::vector<Keyed> buffer;
+            sort_prefixed(first, keys.data(), n, 0, buffer);
+
+            std::vector<std::string> sorted;
+            sorted.reserve(n);
+            for (const auto &k: keys) sorted.push_back(std::move(first[k.index]));
+            std::move(sorted.begin(), sorted.end(), first);
+        }
+
+        namespace {
+            constexpr char magic[8] = {'M', 'Y', 'C', 'O', 'N', 'T', 'N', 'R'};
+        }
+
+        void write_header(std::ostream &os, const SnapshotHeader &header) {
+            write_bytes(os, magic, sizeof(magic));
+            write_bytes(os, &header, sizeof(header));
+        }
+
+        SnapshotHeader read_header(std::istream &is) {
+            char found[sizeof(magic)];
+            read_bytes(is, found, sizeof(found));
+            if (!std::equal(found, found + sizeof(found), magic)) throw std::runtime_error("Not a container snapshot");
+            SnapshotHeader header;
+            read_bytes(is, &header, sizeof(header));
+            if (header.version == 0 || header.version > SnapshotHeader::current_version)
+                throw std::runtime_error("Unsupported snapshot version " + std::to_string(header.version));
+            return header;
+        }
+
+        void write_bytes(std::ostream &os, const void *bytes, const size_t n) {
+            if (n) os.write(static_cast<const char *>(bytes), static_cast<std::streamsize>(n));
+            if (!os) throw std::runtime_error("Snapshot write failed");
+        }
+
+        uint64_t fingerprint_bytes(const char *bytes, const size_t n) {
+            // FNV-1a, then a splitmix64 finalizer so that sums of fingerprints do not cancel out
+            uint64_t h = 0xcbf29ce484222325;
+            for (size_t i = 0; i < n; ++i) h = (h ^ static_cast<unsigned char>(bytes[i])) * 0x100000001b3;
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+            return h ^ (h >> 31);
+        }
+
+        void read_bytes(std::istream &is, void *bytes, const size_t n) {
+            if (n && !is.read(static_cast<char *>(bytes), static_cast<std::streamsize>(n)))
+                throw std::runtime_error("Truncated snapshot");
+        }
+
+        bool check_remaining(std::istream &is, const uint64_t n) {
+            const auto at = is.tellg();
+            if (at < 0) return false;
+            is.seekg(0, std::ios::end);
+            const auto last = is.tellg();
+            is.clear();
+            is.seekg(at);
+            if (last < 0 || !is) return false;
+            if (n > static_cast<uint64_t>(last - at)) throw std::runtime_error("Truncated snapshot");
+            return true;
+        }
+    } // namespace detail
 } // containers
\ No newline at end of file
@@ -6,25 +6,652 @@
 #define CONTAINERS_HPP
 
 #include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <vector>
 #include <stdexcept>
 #include <iterator>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "file.hpp"
+#include "generator.hpp"
+#include "parallel.hpp"
+#include "simd.hpp"
+#include "text.hpp"
+#include "varint.hpp"
 
 namespace containers {
+    /* Views */
+
+    // immutable elements shared by the iterators walking over them
+    template<typename T>
+    using View = std::shared_ptr<const std::vector<T>>;
+
+    // How an order visits a view: its i-th position reads element walk_index(walk, i, n) of the n in the view.
+    enum class Walk { Forward, Backward, SideCross, MiddleOut };
+
+    constexpr size_t walk_index(const Walk walk, const size_t i, const size_t n) {
+        switch (walk) {
+            case Walk::Backward: return n - 1 - i;
+            case Walk::SideCross: return i % 2 == 0 ? i / 2 : n - 1 - i / 2;
+            case Walk::MiddleOut: return i % 2 == 0 ? n / 2 + i / 2 : n / 2 - i / 2 - 1;
+            default: return i;
+        }
+    }
+
+    // [first, last) of an order, consumable with range-for
+    template<typename It>
+    struct Range {
+        It first, last;
+
+        It begin() const { return first; }
+        It end() const { return last; }
+
+        size_t size() const { return static_cast<int>(last) - static_cast<int>(first); }
+    };
+
+    // The orders of the containers built beside MyContainer: a position in a walk over Derived::size()
+    // elements, each read through Derived::element(at), the at-th in storage order. Value is what reading
+    // returns, a reference only when the element lasts as long as the iterator. A Derived with run(at), the
+    // elements from at on that lie next to each other in storage, hands out forward batches in place.
+    template<typename Derived, typename Value>
+    class WalkIterator {
+    public:
+        using value_type = std::remove_cvref_t<Value>;
+
+    protected:
+        int pos = 0;
+        Walk walk = Walk::Forward;
+
+        explicit WalkIterator(const Walk walk) : walk(walk) {}
+
+        const Derived &self() const { return static_cast<const Derived &>(*this); }
+        Derived &self() { return static_cast<Derived &>(*this); }
+
+        size_t position() const { return std::min<size_t>(std::max(pos, 0), self().size()); }
+
+    public:
+        Derived &begin() {
+            pos = 0;
+            return self();
+        }
+
+        Derived &end() {
+            pos = static_cast<int>(self().size());
+            return self();
+        }
+
+        explicit operator bool() const { return pos >= 0 && static_cast<size_t>(pos) < self().size(); }
+        explicit operator int() const { return pos; }
+
+        Value operator[](const int i) const {
+            const auto index = i + pos;
+            const size_t n = self().size();
+            if (index < 0 || static_cast<size_t>(index) >= n) throw std::out_of_range("Iterator out of range");
+            return self().element(walk_index(walk, index, n));
+        }
+
+        Value operator*() const { return (*this)[0]; }
+
+        Derived &operator++() {
+            pos++;
+            return self();
+        }
+
+        Derived operator++(int) {
+            Derived tmp = self();
+            pos++;
+            return tmp;
+        }
+
+        Derived &operator--() {
+            pos--;
+            return self();
+        }
+
+        Derived operator--(int) {
+            Derived tmp = self();
+            pos--;
+            return tmp;
+        }
+
+        /* Batches (as for MyContainer's orders) */
+
+        size_t next_batch(std::span<value_type> out) {
+            const size_t first = position(), n = self().size(), k = std::min(out.size(), n - first);
+            for (size_t i = 0; i < k; ++i) out[i] = self().element(walk_index(walk, first + i, n));
+            pos = static_cast<int>(first + k);
+            return k;
+        }
+
+        template<typename F>
+        void for_each_batch(F &&fn, size_t batch = 1024) {
+            batch = std::max<size_t>(batch, 1);
+            if constexpr (requires(const Derived &d) { d.run(size_t{}); }) {
+                if (walk == Walk::Forward) {
+                    for (size_t first; (first = position()) < self().size();) {
+                        const std::span<const value_type> run = self().run(first);
+                        const size_t k = std::min(batch, run.size());
+                        pos = static_cast<int>(first + k);
+                        fn(run.first(k));
+                    }
+                    return;
+                }
+            }
+            std::vector<value_type> buffer(std::min(batch, self().size()));
+            while (const size_t k = next_batch(buffer)) fn(std::span<const value_type>(buffer.data(), k));
+        }
+    };
+
+    // An order of such a container: It walked the W way, made from what It is made from before the walk
+    template<typename It, Walk W>
+    class WalkOrder : public It {
+    public:
+        template<typename Source>
+        explicit WalkOrder(const Source &source) : It(source, W) {}
+    };
+
+    template<typename It>
+    It at_begin(It it) {
+        it.begin();
+        return it;
+    }
+
+    template<typename It>
+    It at_end(It it) {
+        it.end();
+        return it;
+    }
+
+    namespace detail {
+        // Sorts strings by (8-byte big-endian key prefix, index) pairs, so the hot loop compares integers.
+        // Runs of equal prefixes are re-keyed on their next 8 bytes; only strings that end inside a tied
+        // prefix fall back to full comparison.
+        void sort_strings(std::string *first, size_t n);
+
+        // ascending sort, through the vectorized kernel for the key types it covers
+        template<typename T>
+        void sort_run(T *first, const size_t n) {
+            if constexpr (std::is_same_v<T, int> || std::is_same_v<T, float> || std::is_same_v<T, double>)
+                simd::sort(first, n);
+            else if constexpr (std::is_same_v<T, std::string>) sort_strings(first, n);
+            else std::sort(first, first + n);
+        }
+
+        template<typename T>
+        void sort(std::vector<T> &v, const Parallelism &p) {
+            if (p.applies(v.size())) parallel_sort(v.data(), v.size(), p.threads, sort_run<T>);
+            else sort_run(v.data(), v.size());
+        }
+
+        template<typename T>
+        constexpr bool simd_searchable = std::is_same_v<T, int> || std::is_same_v<T, double> || std::is_same_v<T, char>;
+
+        template<typename T>
+        size_t count(const std::vector<T> &v, const T &value) {
+            if constexpr (simd_searchable<T>) return simd::count(v.data(), v.size(), value);
+            else return std::count(v.begin(), v.end(), value);
+        }
+
+        template<typename T>
+        bool contains(const std::vector<T> &v, const T &value) {
+            if constexpr (simd_searchable<T>) return simd::find(v.data(), v.size(), value) < v.size();
+            else return std::find(v.begin(), v.end(), value) != v.end();
+        }
+
+        // erases every element equal to value, returns how many were erased
+        template<typename T>
+        size_t remove(std::vector<T> &v, const T &value) {
+            const size_t n = v.size();
+            if constexpr (simd_searchable<T>) v.resize(simd::remove(v.data(), n, value));
+            else v.erase(std::remove(v.begin(), v.end(), value), v.end());
+            return n - v.size();
+        }
+
+        // removes every occurrence of any of values in one pass, returns how many elements went
+        template<typename T>
+        size_t remove_all(std::vector<T> &v, std::vector<T> values) {
+            if (values.size() == 1) return remove(v, values.front());
+            std::sort(values.begin(), values.end());
+            values.erase(std::unique(values.begin(), values.end()), values.end());
+            const size_t n = v.size();
+            v.erase(std::remove_if(v.begin(), v.end(), [&](const T &x) {
+                return std::binary_search(values.begin(), values.end(), x);
+            }), v.end());
+            return n - v.size();
+        }
+
+        /* Reductions */
+
+        template<typename T>
+        using sum_t = std::conditional_t<std::is_integral_v<T>, long long, double>;
+
+        struct Kahan {
+            double sum = 0, c = 0;
+
+            void add(const double x) {
+                const double y = x - c, t = sum + y;
+                c = t - sum - y;
+                sum = t;
+            }
+        };
+
+        template<typename T>
+        std::pair<T, T> minmax_run(const T *first, const size_t n) {
+            if constexpr (simd_searchable<T>) {
+                T lo, hi;
+                simd::minmax(first, n, lo, hi);
+                return {lo, hi};
+            } else {
+                const auto [lo, hi] = std::minmax_element(first, first + n);
+                return {*lo, *hi};
+            }
+        }
+
+        template<typename T>
+        sum_t<T> sum_run(const T *first, const size_t n) {
+            if constexpr (simd_searchable<T>) return simd::sum(first, n);
+            else if constexpr (std::is_integral_v<T>) {
+                sum_t<T> s = 0;
+                for (size_t i = 0; i < n; ++i) s += first[i];
+                return s;
+            } else {
+                Kahan k;
+                for (size_t i = 0; i < n; ++i) k.add(first[i]);
+                return k.sum;
+            }
+        }
+
+        template<typename T>
+        double squared_deviations_run(const T *first, const size_t n, const double mean) {
+            if constexpr (simd_searchable<T>) return simd::squared_deviations(first, n, mean);
+            else {
+                Kahan k;
+                for (size_t i = 0; i < n; ++i) k.add((first[i] - mean) * (first[i] - mean));
+                return k.sum;
+            }
+        }
+
+        // Partial results of run(first, n) over fixed chunks of v, on up to p.threads workers. The chunks do not
+        // depend on the thread count, so neither do floating point results.
+        constexpr size_t reduce_grain = 1 << 16;
+
+        template<typename T, typename F>
+        auto reduce_chunks(const std::vector<T> &v, const Parallelism &p, F &&run) {
+            const size_t n = v.size();
+            std::vector<decltype(run(v.data(), n))> partial((n + reduce_grain - 1) / reduce_grain);
+            const auto body = [&](const size_t b, const size_t e) {
+                for (size_t c = b / reduce_grain; c * reduce_grain < e; ++c) {
+                    const size_t lo = c * reduce_grain, hi = std::min(n, lo + reduce_grain);
+                    partial[c] = run(v.data() + lo, hi - lo);
+                }
+            };
+            if (p.applies(n)) parallel_for(n, reduce_grain, p.threads, body);
+            else body(0, n);
+            return partial;
+        }
+
+        template<typename T>
+        View<T> sorted_copy(const std::vector<T> &v, const Parallelism &p) {
+            auto sorted = std::make_shared<std::vector<T>>(v);
+            sort(*sorted, p);
+            return sorted;
+        }
+
+        /* Front coding (walked and searched by FrontCodedIndex, frontcoded.hpp) */
+
+        // Sorted strings, every entry stored as the length of the prefix it shares with the entry before it,
+        // then the rest of it (both lengths as varints); every interval-th entry is stored whole, so that any
+        // entry decodes from the restart before it.
+        struct FrontCoded {
+            std::string bytes;
+            std::vector<uint64_t> restarts; // offset of every restart entry in bytes
+            size_t count = 0;
+            size_t interval = 32;
+
+            // decodes the entry at p on top of the one before it (in s), moving p past it
+            static void decode(const char *&p, const char *end, std::string &s) {
+                const size_t shared = get_varint(p, end);
+                const size_t rest = get_varint(p, end);
+                s.resize(shared);
+                s.append(p, rest);
+                p += rest;
+            }
+
+            // the restart entry of a block, read in place
+            std::string_view restart_entry(const size_t block) const {
+                const char *p = bytes.data() + restarts[block], *end = bytes.data() + bytes.size();
+                get_varint(p, end);
+                const size_t n = get_varint(p, end);
+                return {p, n};
+            }
+
+            // calls fn(std::string_view) on the entries of a block in order
+            template<typename F>
+            void for_each_in_block(const size_t block, F &&fn) const {
+                const char *p = bytes.data() + restarts[block], *end = bytes.data() + bytes.size();
+                const size_t n = std::min(interval, count - block * interval);
+                std::string s;
+                for (size_t i = 0; i < n; ++i) {
+                    decode(p, end, s);
+                    fn(std::string_view(s));
+                }
+            }
+        };
+
+        // encodes sorted strings (or views of them) with a restart every `restart` entries
+        template<typename S>
+        std::shared_ptr<const FrontCoded> front_code(const std::vector<S> &sorted, const size_t restart) {
+            auto e = std::make_shared<FrontCoded>();
+            e->count = sorted.size();
+            e->interval = std::max<size_t>(restart, 1);
+            e->restarts.reserve((sorted.size() + e->interval - 1) / e->interval);
+            for (size_t i = 0; i < sorted.size(); ++i) {
+                const std::string_view a = i ? std::string_view(sorted[i - 1]) : "", b = sorted[i];
+                size_t shared = 0;
+                if (i % e->interval == 0) e->restarts.push_back(e->bytes.size());
+                else {
+                    const size_t n = std::min(a.size(), b.size());
+                    shared = std::mismatch(a.begin(), a.begin() + n, b.begin()).first - a.begin();
+                }
+                put_varint(e->bytes, shared);
+                put_varint(e->bytes, b.size() - shared);
+                e->bytes.append(b.substr(shared));
+            }
+            e->bytes.shrink_to_fit();
+            return e;
+        }
+
+        // the entries decoded into a sorted view, in one pass
+        inline View<std::string> decode(const FrontCoded &e) {
+            auto v = std::make_shared<std::vector<std::string>>();
+            v->reserve(e.count);
+            const char *p = e.bytes.data(), *end = e.bytes.data() + e.bytes.size();
+            std::string s;
+            for (size_t i = 0; i < e.count; ++i) {
+                FrontCoded::decode(p, end, s);
+                v->push_back(s);
+            }
+            return v;
+        }
+
+        // positions per task of the parallel algorithms over an order
+        constexpr size_t walk_grain = 1 << 14;
+
+        // sorted copy of elements, built on the shared pool
+        template<typename T>
+        std::shared_future<View<T>> sorted_copy_async(View<T> elements, const Parallelism &p) {
+            auto promise = std::make_shared<std::promise<View<T>>>();
+            auto future = promise->get_future().share();
+            ThreadPool::shared().submit([elements = std::move(elements), p, promise] {
+                try {
+                    promise->set_value(sorted_copy(*elements, p));
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            });
+            return future;
+        }
+
+        // waits for a future fed by the shared pool, running queued pool tasks meanwhile (it may be one of them)
+        template<typename R>
+        R await(const std::shared_future<R> &future) {
+            while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                if (!ThreadPool::shared().run_pending()) future.wait_for(std::chrono::microseconds(100));
+            return future.get();
+        }
+
+        template<typename S>
+        S total(const std::vector<S> &partial) {
+            if constexpr (std::is_integral_v<S>) {
+                S s = 0;
+                for (const auto x: partial) s += x;
+                return s;
+            } else {
+                Kahan k;
+                for (const auto x: partial) k.add(x);
+                return k.sum;
+            }
+        }
+
+        /* Binary snapshots */
+
+        // Layout, in native byte order: the 8-byte magic "MYCONTNR", then this header, then the elements -
+        // one block of count * element_size bytes for trivially copyable types, or count 64-bit lengths
+        // followed by one blob of all the bytes for strings. With the sorted_index flag (version 2), the
+        // elements are followed by their 64-bit fingerprint() and by the sorted elements, encoded the same way.
+        struct SnapshotHeader {
+            static constexpr uint32_t current_version = 2;
+            static constexpr uint32_t sorted_index = 1; // flag
+
+            uint32_t version = current_version;
+            uint32_t type = 0; // type_code<T>()
+            uint32_t element_size = 0;
+            uint32_t flags = 0;
+            uint64_t count = 0;
+        };
+
+        void write_header(std::ostream &os, const SnapshotHeader &header);
+
+        // throws unless the stream holds a snapshot header of a version this build reads
+        SnapshotHeader read_header(std::istream &is);
+
+        void write_bytes(std::ostream &os, const void *bytes, size_t n);
+
+        // throws if the stream ends first
+        void read_bytes(std::istream &is, void *bytes, size_t n);
+
+        // Throws if a seekable stream holds fewer than n more bytes; false if the stream cannot tell.
+        bool check_remaining(std::istream &is, uint64_t n);
+
+        // Reads count values of a trivially copyable type. A count that a seekable stream cannot hold is
+        // rejected before anything is allocated; from other streams the values are read in pieces, so a
+        // corrupt count allocates no more than the stream really holds before it runs out.
+        template<typename U>
+        std::vector<U> read_array(std::istream &is, const uint64_t count) {
+            if (count > UINT64_MAX / sizeof(U)) throw std::runtime_error("Truncated snapshot");
+            const uint64_t piece = check_remaining(is, count * sizeof(U)) ? count : (1 << 20) / sizeof(U);
+            std::vector<U> v;
+            while (v.size() < count) {
+                const size_t at = v.size(), k = std::min<uint64_t>(piece, count - at);
+                v.resize(at + k);
+                read_bytes(is, v.data() + at, k * sizeof(U));
+            }
+            return v;
+        }
+
+        uint64_t fingerprint_bytes(const char *bytes, size_t n);
+
+        // tells element types of the same size apart (0 for types without a code of their own)
+        template<typename T>
+        constexpr uint32_t type_code() {
+            if constexpr (std::is_same_v<T, int>) return 1;
+            else if constexpr (std::is_same_v<T, double>) return 2;
+            else if constexpr (std::is_same_v<T, char>) return 3;
+            else if constexpr (std::is_same_v<T, float>) return 4;
+            else if constexpr (std::is_same_v<T, std::string>) return 5;
+            else return 0;
+        }
+
+        template<typename T>
+        concept serializable = (std::is_trivially_copyable_v<T> && !std::is_same_v<T, std::string_view>) ||
+                               std::is_same_v<T, std::string>;
+
+        // order-independent hash of the elements: a permutation of v has the same fingerprint
+        template<serializable T>
+        uint64_t fingerprint(const std::vector<T> &v) {
+            uint64_t sum = 0;
+            for (const auto &x: v) {
+                if constexpr (std::is_same_v<T, std::string>) sum += fingerprint_bytes(x.data(), x.size());
+                else sum += fingerprint_bytes(reinterpret_cast<const char *>(&x), sizeof(T));
+            }
+            return sum;
+        }
+
+        template<serializable T>
+        void write_payload(std::ostream &os, const std::vector<T> &v) {
+            if constexpr (std::is_same_v<T, std::string>) {
+                std::vector<uint64_t> lengths;
+                lengths.reserve(v.size());
+                for (const auto &s: v) lengths.push_back(s.size());
+                write_bytes(os, lengths.data(), lengths.size() * sizeof(uint64_t));
+                for (const auto &s: v) write_bytes(os, s.data(), s.size());
+            } else write_bytes(os, v.data(), v.size() * sizeof(T));
+        }
+
+        template<serializable T>
+        std::vector<T> read_payload(std::istream &is, const SnapshotHeader &header) {
+            if (header.type != type_code<T>() || header.element_size != sizeof(T))
+                throw std::runtime_error("Snapshot holds another element type");
+            if constexpr (std::is_same_v<T, std::string>) {
+                const auto lengths = read_array<uint64_t>(is, header.count);
+                uint64_t total = 0;
+                for (const auto n: lengths)
+                    if ((total += n) < n) throw std::runtime_error("Truncated snapshot");
+                const auto blob = read_array<char>(is, total);
+                std::vector<T> v;
+                v.reserve(header.count);
+                const char *next = blob.data();
+                for (const auto n: lengths) {
+                    v.emplace_back(next, n);
+                    next += n;
+                }
+                return v;
+            } else return read_array<T>(is, header.count);
+        }
+    } // namespace detail
+
     /* Container */
     template<typename T>
     class MyContainer {
-        std::vector<T> data;
+        // shared by copies and by the views of the elements until the next modification detaches it
+        std::shared_ptr<std::vector<T>> data = std::make_shared<std::vector<T>>();
+        Parallelism parallelism;
+        size_t generation = 0; // bumped by every modification
+        size_t presort_from = SIZE_MAX; // size from which reads start a background re-sort (off by default)
+        size_t presort_after = 8; // reads in a row, with no modification between them, that start it
+        size_t front_coding = 0; // restart interval of the front-coded sorted index strings keep instead, if any
+        std::shared_ptr<const void> source; // keeps alive whatever the elements point into (see keep_alive)
+
+        // everything derived from the elements, valid while generation matches
+        struct Cache {
+            size_t generation = 0;
+            std::optional<std::pair<T, T>> minmax = std::nullopt;
+            std::optional<detail::sum_t<T>> sum = std::nullopt;
+            std::optional<double> variance = std::nullopt;
+            View<T> sorted;
+            std::shared_future<View<T>> sorting; // sorted view under way in the background
+            size_t reads = 0; // reads seen by presort()
+            // with front coding, kept instead of sorted, and the sorted view last decoded from it while it lasts
+            std::shared_ptr<const detail::FrontCoded> front_coded;
+            std::weak_ptr<const std::vector<T>> decoded;
+        };
+
+        mutable Cache cache;
+
+        void touch() { ++generation; }
+
+        // the storage, about to be modified: copied first if anything else still shares it
+        std::vector<T> &detach() {
+            if (data.use_count() > 1) data = std::make_shared<std::vector<T>>(*data);
+            return *data;
+        }
+
+        Cache &fresh_cache() const {
+            if (cache.generation != generation) {
+                cache = Cache();
+                cache.generation = generation;
+            }
+            return cache;
+        }
+
+        // a view that also holds the source, for views handed out of a container that has one
+        static View<T> share(View<T> v, const std::shared_ptr<const void> &source) {
+            if (!source || !v) return v;
+            auto both = std::make_shared<const std::pair<std::shared_ptr<const void>, View<T>>>(source, v);
+            return View<T>(both, v.get());
+        }
+
+        // the storage itself; the next modification leaves it to the iterators holding it
+        View<T> view() const {
+            presort();
+            return share(data, source);
+        }
+
+        View<T> sorted_view(const Parallelism &p) const {
+            auto &c = fresh_cache();
+            if (front_coding) return decoded_view(c, p);
+            if (!c.sorted) c.sorted = c.sorting.valid() ? detail::await(c.sorting) : detail::sorted_copy(*data, p);
+            return share(c.sorted, source);
+        }
+
+        // With front coding, the cache keeps the encoding only: a sorted view is decoded from it in O(n) and
+        // lasts as long as something (an order, say) holds it, so the strings are doubled only meanwhile.
+        View<T> decoded_view(Cache &c, const Parallelism &p) const {
+            if constexpr (std::is_same_v<T, std::string>) {
+                if (auto v = c.decoded.lock()) return v;
+                View<T> v;
+                if (c.front_coded) v = detail::decode(*c.front_coded);
+                else {
+                    v = c.sorting.valid() ? detail::await(c.sorting) : detail::sorted_copy(*data, p);
+                    c.front_coded = detail::front_code(*v, front_coding);
+                    c.sorting = {}; // would hold on to the sorted copy
+                }
+                c.decoded = v;
+                return v;
+            } else return nullptr;
+        }
+
+        std::shared_future<View<T>> sorted_view_async() const {
+            auto &c = fresh_cache();
+            if (c.sorting.valid()) return c.sorting;
+            if (c.sorted || c.front_coded) {
+                std::promise<View<T>> ready;
+                ready.set_value(sorted_view(parallelism));
+                if (c.front_coded) return ready.get_future().share();
+                c.sorting = ready.get_future().share();
+            } else c.sorting = detail::sorted_copy_async<T>(data, parallelism);
+            return c.sorting;
+        }
+
+        // Called by reads: once presort_after of them came in a row after a run of modifications, re-sorting
+        // starts, if the policy is on. Reads interleaved with writes never get there, which matters because a
+        // re-sort under way shares the storage and so makes the next write copy it.
+        void presort() const {
+            if (data->size() < presort_from) return;
+            auto &c = fresh_cache();
+            if (c.sorted || c.front_coded || c.sorting.valid() || ++c.reads < presort_after) return;
+            sorted_view_async();
+        }
 
     public:
         MyContainer() = default;
 
-        MyContainer(const MyContainer &other) { *this = other; }
+        // copies share the elements and everything cached about them, in O(1)
+        MyContainer(const MyContainer &other)
+            : data(other.data), parallelism(other.parallelism), generation(other.generation),
+              presort_from(other.presort_from), presort_after(other.presort_after), front_coding(other.front_coding),
+              source(other.source), cache(other.cache) {}
 
         MyContainer &operator=(const MyContainer &other) {
-            data.clear();
-            for (const auto &d: other.data) data.push_back(d);
+            data = other.data;
+            parallelism = other.parallelism;
+            generation = other.generation;
+            presort_from = other.presort_from;
+            presort_after = other.presort_after;
+            front_coding = other.front_coding;
+            source = other.source;
+            cache = other.cache;
             return *this;
         }
 
@@ -32,35 +659,439 @@ namespace containers {
 
         /* Element Modify methods*/
 
-        void add(const T &value) { data.push_back(value); }
+        void add(const T &value) {
+            detach().push_back(value);
+            touch();
+        }
+
+        // appends values in order, as one modification
+        void add_all(std::vector<T> values) {
+            if (values.empty()) return;
+            if (data->empty()) data = std::make_shared<std::vector<T>>(std::move(values));
+            else {
+                auto &v = detach();
+                v.reserve(v.size() + values.size());
+                std::move(values.begin(), values.end(), std::back_inserter(v));
+            }
+            touch();
+        }
+
+        // Keeps owner alive as long as this container, its copies or anything built from their elements (iterators,
+        // views, generators) is: for elements that point into memory owned elsewhere, such as the string_views
+        // of MyContainer<std::string_view>. Owners add up.
+        void keep_alive(std::shared_ptr<const void> owner) {
+            if (!source) source = std::move(owner);
+            else source = std::make_shared<const std::pair<std::shared_ptr<const void>, std::shared_ptr<const void>>>(
+                    std::move(source), std::move(owner));
+        }
 
         void remove(const T &value) {
-            bool found = false;
-            for (auto it = data.begin(); it != data.end();) {
-                if (*it == value) {
-                    it = data.erase(it);
-                    found = true;
-                } else ++it;
+            if (!try_remove(value)) throw std::runtime_error("Value not found in container");
+        }
+
+        // removes every occurrence of value, returns how many there were
+        size_t try_remove(const T &value) {
+            if (data.use_count() > 1 && !contains(value)) return 0; // nothing to remove, keep sharing
+            const size_t removed = detail::remove(detach(), value);
+            if (removed) touch();
+            return removed;
+        }
+
+        // removes every occurrence of any of values, as one modification and in one pass over the elements;
+        // returns how many elements went
+        size_t remove_all(std::vector<T> values) {
+            if (values.empty() || data->empty()) return 0;
+            const size_t removed = detail::remove_all(detach(), std::move(values));
+            if (removed) touch();
+            return removed;
+        }
+
+        size_t size() const { return data->size(); }
+
+        /* Search */
+
+        bool contains(const T &value) const {
+            presort();
+            return detail::contains(*data, value);
+        }
+
+        size_t count(const T &value) const {
+            presort();
+            return detail::count(*data, value);
+        }
+
+        /* Aggregates (cached until the container is modified; all but sum() throw when it is empty) */
+
+        T min() const { return minmax().first; }
+
+        T max() const { return minmax().second; }
+
+        std::pair<T, T> minmax() const {
+            presort();
+            auto &c = fresh_cache();
+            if (!c.minmax) {
+                if (data->empty()) throw std::runtime_error("Container is empty");
+                const auto partial = detail::reduce_chunks(*data, parallelism, detail::minmax_run<T>);
+                auto result = partial.front();
+                for (const auto &[lo, hi]: partial) {
+                    if (lo < result.first) result.first = lo;
+                    if (result.second < hi) result.second = hi;
+                }
+                c.minmax = result;
             }
-            if (!found) throw std::runtime_error("Value not found in container");
+            return *c.minmax;
         }
 
-        size_t size() const { return data.size(); }
+        detail::sum_t<T> sum() const requires std::is_arithmetic_v<T> {
+            presort();
+            auto &c = fresh_cache();
+            if (!c.sum) c.sum = detail::total(detail::reduce_chunks(*data, parallelism, detail::sum_run<T>));
+            return *c.sum;
+        }
+
+        double mean() const requires std::is_arithmetic_v<T> {
+            if (data->empty()) throw std::runtime_error("Container is empty");
+            return static_cast<double>(sum()) / static_cast<double>(data->size());
+        }
+
+        // population variance
+        double variance() const requires std::is_arithmetic_v<T> {
+            const double m = mean();
+            auto &c = fresh_cache();
+            if (!c.variance) {
+                const auto partial = detail::reduce_chunks(*data, parallelism, [m](const T *first, const size_t n) {
+                    return detail::squared_deviations_run(first, n, m);
+                });
+                c.variance = detail::total(partial) / static_cast<double>(data->size());
+            }
+            return *c.variance;
+        }
+
+        /* Parallelism (default for the orders built from this container) */
+
+        const Parallelism &get_parallelism() const { return parallelism; }
+
+        void set_parallelism(const Parallelism &p) { parallelism = p; }
+
+        /* Views (shared with the iterators built before the next modification) */
+
+        View<T> elements() const { return view(); }
+
+        View<T> sorted_elements() const { return sorted_view(parallelism); }
+
+        /* Background sorting */
+
+        // Starts building the sorted view of the current elements on the shared pool (unless it is built or
+        // under way already); the sorted orders built later in this generation pick it up, waiting for it if
+        // needed. Modifying the container meanwhile does not affect the result.
+        std::shared_future<View<T>> prepare_sorted_async() const {
+            auto sorting = sorted_view_async();
+            if (!source) return sorting;
+            return std::async(std::launch::deferred, [sorting, source = source] {
+                return share(sorting.get(), source);
+            }).share();
+        }
+
+        // When on, a container holding at least min_size elements starts re-sorting in the background once
+        // its modifications settle: after `after` reads (insertion orders, searches, aggregates) in a row with
+        // no modification between them. Latency-sensitive sorted reads then find the index ready or under
+        // way, while read-modify loops such as `if (!c.contains(x)) c.add(x);` never start a sort.
+        void set_auto_presort(const bool on, const size_t min_size = 1 << 16, const size_t after = 8) {
+            presort_from = on ? min_size : SIZE_MAX;
+            presort_after = std::max<size_t>(after, 1);
+        }
+
+        /* Front coding (strings) */
+
+        // With a restart interval (16 to 64, see FrontCodedIndex), the sorted index is kept front-coded instead
+        // of as a sorted copy of every string, several times smaller when the strings share prefixes. Sorted
+        // orders decode it into a sorted view that lasts as long as they hold it. 0, the default, turns it off.
+        void set_front_coding(const size_t restart) requires std::is_same_v<T, std::string> {
+            front_coding = restart;
+            auto &c = fresh_cache();
+            c.sorted = nullptr;
+            c.front_coded = nullptr;
+            c.decoded.reset();
+        }
+
+        size_t get_front_coding() const { return front_coding; }
+
+        // the front-coded sorted index (built if needed), null with front coding off
+        std::shared_ptr<const detail::FrontCoded> front_coded() const requires std::is_same_v<T, std::string> {
+            if (!front_coding) return nullptr;
+            auto &c = fresh_cache();
+            if (!c.front_coded) decoded_view(c, parallelism);
+            return c.front_coded;
+        }
 
+        /* Binary snapshots (see detail::SnapshotHeader for the format) */
+
+        // With sorted_index, the sorted view is saved too (sorting first if needed), so that a container
+        // loaded from the snapshot has every sorted order available without sorting.
+        void save(std::ostream &os, const bool sorted_index = false) const requires detail::serializable<T> {
+            using detail::SnapshotHeader;
+            const View<T> sorted = sorted_index ? sorted_view(parallelism) : nullptr;
+            detail::write_header(os, {SnapshotHeader::current_version, detail::type_code<T>(), sizeof(T),
+                                      sorted ? SnapshotHeader::sorted_index : 0, data->size()});
+            detail::write_payload(os, *data);
+            if (!sorted) return;
+            const uint64_t stamp = detail::fingerprint(*data);
+            detail::write_bytes(os, &stamp, sizeof(stamp));
+            detail::write_payload(os, *sorted);
+        }
+
+        void save(const std::string &path, const bool sorted_index = false) const
+            requires detail::serializable<T> {
+            std::ofstream os(path, std::ios::binary | std::ios::trunc);
+            if (!os) throw std::runtime_error("Cannot open " + path);
+            save(os, sorted_index);
+            os.flush();
+            if (!os) throw std::runtime_error("Cannot write " + path);
+        }
+
+        // A saved sorted index is adopted once checked against the elements (in order, and with the same
+        // fingerprint as them), which costs O(n) instead of a sort.
+        static MyContainer load(std::istream &is) requires detail::serializable<T> {
+            const auto header = detail::read_header(is);
+            MyContainer c;
+            *c.data = detail::read_payload<T>(is, header);
+            if (header.flags & detail::SnapshotHeader::sorted_index) {
+                uint64_t stamp;
+                detail::read_bytes(is, &stamp, sizeof(stamp));
+                auto sorted = detail::read_payload<T>(is, header);
+                if (!std::is_sorted(sorted.begin(), sorted.end()) || detail::fingerprint(*c.data) != stamp ||
+                    detail::fingerprint(sorted) != stamp)
+                    throw std::runtime_error("Snapshot sorted index does not match its elements");
+                c.fresh_cache().sorted = std::make_shared<const std::vector<T>>(std::move(sorted));
+            }
+            return c;
+        }
+
+        static MyContainer load(const std::string &path) requires detail::serializable<T> {
+            std::ifstream is(path, std::ios::binary);
+            if (!is) throw std::runtime_error("Cannot open " + path);
+            return load(is);
+        }
+
+        // Reads a text file of delimiter-separated values (see parse_into) into a new container; the file is
+        // mapped rather than read into a buffer. The string_views of MyContainer<std::string_view> point into the
+        // mapping, which the container keeps alive.
+        static MyContainer load_text(const std::string &path) requires detail::text_parsable<T> {
+            const auto file = detail::File::read_only(path);
+            MyContainer c;
+            if (const size_t bytes = file.size()) {
+                auto text = std::make_shared<const detail::Mapping>(file, bytes, false);
+                text->advise(detail::Access::Sequential);
+                c.add_all(detail::parse_text<T>(std::string_view(text->data(), bytes), c.parallelism));
+                // string_views point into the mapping
+                if constexpr (std::is_same_v<T, std::string_view>) c.keep_alive(std::move(text));
+            }
+            return c;
+        }
+
+        /* Text output ("x " per element, as operator<< writes; streams get the blocks through write()) */
+
+        void write_order(std::ostream &os) const { write_walk(os, *view(), Walk::Forward, parallelism); }
+        void write_reverse_order(std::ostream &os) const { write_walk(os, *view(), Walk::Backward, parallelism); }
+        void write_ascending(std::ostream &os) const { write_sorted(os, Walk::Forward); }
+        void write_descending(std::ostream &os) const { write_sorted(os, Walk::Backward); }
+        void write_side_cross(std::ostream &os) const { write_sorted(os, Walk::SideCross); }
+        void write_middle_out(std::ostream &os) const { write_sorted(os, Walk::MiddleOut); }
+
+        // straight to a file descriptor, with the default stream precision for floating point
+        void write_order(const int fd) const requires detail::text_formattable<T> {
+            write_walk(fd, *view(), Walk::Forward, parallelism);
+        }
+
+        void write_reverse_order(const int fd) const requires detail::text_formattable<T> {
+            write_walk(fd, *view(), Walk::Backward, parallelism);
+        }
+
+        void write_ascending(const int fd) const requires detail::text_formattable<T> {
+            write_sorted(fd, Walk::Forward);
+        }
+
+        void write_descending(const int fd) const requires detail::text_formattable<T> {
+            write_sorted(fd, Walk::Backward);
+        }
+
+        void write_side_cross(const int fd) const requires detail::text_formattable<T> {
+            write_sorted(fd, Walk::SideCross);
+        }
+
+        void write_middle_out(const int fd) const requires detail::text_formattable<T> {
+            write_sorted(fd, Walk::MiddleOut);
+        }
+
+    private:
+        static void write_walk(std::ostream &os, const std::vector<T> &v, const Walk walk, const Parallelism &p) {
+            const size_t n = v.size();
+            if constexpr (detail::text_formattable<T>) {
+                if (const auto precision = detail::plain_precision(os)) {
+                    detail::format_text(n, [&](const size_t i) -> const T &{ return v[walk_index(walk, i, n)]; },
+                                        *precision, p,
+                                        [&](const char *text, const size_t k) {
+                                            os.write(text, static_cast<std::streamsize>(k));
+                                        });
+                    return;
+                }
+            }
+            for (size_t i = 0; i < n; ++i) os << v[walk_index(walk, i, n)] << " ";
+        }
+
+        static void write_walk(const int fd, const std::vector<T> &v, const Walk walk, const Parallelism &p) {
+            const size_t n = v.size();
+            detail::format_text(n, [&](const size_t i) -> const T &{ return v[walk_index(walk, i, n)]; },
+                                6, p, [fd](const char *text, const size_t k) { detail::write_fd(fd, text, k); });
+        }
+
+        template<typename Out>
+        void write_sorted(Out &&out, const Walk walk) const {
+            write_walk(out, *sorted_view(parallelism), walk, parallelism);
+        }
+
+    public:
+        /* Generators (lazy, over the elements as of the call; modifying the container meanwhile is fine) */
+
+        Generator<T> generate_order() const { return generate(view(), Walk::Forward); }
+
+        Generator<T> generate_reverse_order() const { return generate(view(), Walk::Backward); }
+
+        Generator<T> generate_ascending_order() const { return generate_sorted(Walk::Forward); }
+
+        Generator<T> generate_descending_order() const { return generate_sorted(Walk::Backward); }
+
+        Generator<T> generate_side_cross_order() const { return generate_sorted(Walk::SideCross); }
+
+        Generator<T> generate_middle_out_order() const { return generate_sorted(Walk::MiddleOut); }
+
+    private:
+        static Generator<T> generate(const View<T> elements, const Walk walk) {
+            const size_t n = elements->size();
+            for (size_t i = 0; i < n; ++i) co_yield (*elements)[walk_index(walk, i, n)];
+        }
+
+        // Sorted walk without a sorted view: after an O(n) partition of positions into the shared view, every
+        // step pops the next one off a heap over the part it comes from, so taking the first k elements costs
+        // O(n + k log n) instead of a full sort, and the elements are neither copied nor moved. The view holds
+        // the source, if any.
+        static Generator<T> generate_selected(const View<T> elements, const Walk walk) {
+            const auto &e = *elements;
+            const auto less = [&](const size_t a, const size_t b) { return e[a] < e[b]; };
+            const auto greater = [&](const size_t a, const size_t b) { return e[b] < e[a]; };
+            const size_t n = e.size();
+            std::vector<size_t> positions(n);
+            std::iota(positions.begin(), positions.end(), size_t{0});
+            const auto first = positions.begin(), last = positions.end();
+            // ascending picks climb through [first, mid), descending ones go down through [mid, last) (or
+            // the other way round for middle-out, which starts from the median)
+            auto mid = last;
+            if (walk == Walk::Backward) mid = first;
+            else if (walk == Walk::SideCross) mid = first + (n + 1) / 2;
+            else if (walk == Walk::MiddleOut) mid = first + n / 2;
+            if (mid != first && mid != last) std::nth_element(first, mid, last, less);
+            const bool middle_out = walk == Walk::MiddleOut;
+            auto up_first = middle_out ? mid : first, up_last = middle_out ? last : mid;
+            auto down_first = middle_out ? first : mid, down_last = middle_out ? mid : last;
+            std::make_heap(up_first, up_last, greater);
+            std::make_heap(down_first, down_last, less);
+            for (size_t i = 0; i < n; ++i) {
+                const bool up = walk == Walk::Forward || (walk != Walk::Backward && i % 2 == 0);
+                if (up) {
+                    std::pop_heap(up_first, up_last--, greater);
+                    co_yield e[*up_last];
+                } else {
+                    std::pop_heap(down_first, down_last--, less);
+                    co_yield e[*down_last];
+                }
+            }
+        }
+
+        Generator<T> generate_sorted(const Walk walk) const {
+            const auto &c = fresh_cache();
+            if (c.sorted) return generate(share(c.sorted, source), walk);
+            if (c.front_coded) return generate(sorted_view(parallelism), walk);
+            if (c.sorting.valid() && c.sorting.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                return generate(share(c.sorting.get(), source), walk);
+            return generate_selected(share(data, source), walk);
+        }
+
+    public:
         /* Operators */
 
-        T &operator[](size_t index) {
-            if (index >= data.size()) throw std::runtime_error("Index out of range");
-            return data.at(index);
+        // Element of a container that may be assigned to, returned by the non-const operator[] in place of a
+        // T&. Every write is a modification of its own (the storage is detached from copies and iterators
+        // first, and the cache dropped), so nothing can write into storage that has been shared since the
+        // element was taken. Reads go through the conversion to const T& or through ->.
+        class Reference {
+            MyContainer *c;
+            size_t index;
+
+            template<typename F>
+            Reference &apply(F &&fn) {
+                fn(c->detach().at(index));
+                c->touch();
+                return *this;
+            }
+
+        public:
+            Reference(MyContainer &c, const size_t index) : c(&c), index(index) {}
+
+            Reference &operator=(const T &value) {
+                return apply([&](T &x) { x = value; });
+            }
+
+            Reference &operator=(const Reference &other) { return *this = other.get(); }
+
+            template<typename U> requires requires(T &x, const U &u) { x += u; }
+            Reference &operator+=(const U &u) {
+                return apply([&](T &x) { x += u; });
+            }
+
+            template<typename U> requires requires(T &x, const U &u) { x -= u; }
+            Reference &operator-=(const U &u) {
+                return apply([&](T &x) { x -= u; });
+            }
+
+            template<typename U> requires requires(T &x, const U &u) { x *= u; }
+            Reference &operator*=(const U &u) {
+                return apply([&](T &x) { x *= u; });
+            }
+
+            template<typename U> requires requires(T &x, const U &u) { x /= u; }
+            Reference &operator/=(const U &u) {
+                return apply([&](T &x) { x /= u; });
+            }
+
+            const T &get() const { return std::as_const(*c)[index]; }
+
+            operator const T &() const { return get(); }
+
+            const T *operator->() const { return &get(); }
+
+            bool operator==(const T &value) const { return get() == value; }
+
+            // swap(c[i], c[j]), found by ADL (std::swap needs lvalues)
+            friend void swap(Reference a, Reference b) {
+                T t = a.get();
+                a = b.get();
+                b = std::move(t);
+            }
+        };
+
+        Reference operator[](size_t index) {
+            if (index >= data->size()) throw std::runtime_error("Index out of range");
+            return {*this, index};
         }
 
         const T &operator[](size_t index) const {
-            if (index >= data.size()) throw std::runtime_error("Index out of range");
-            return data.at(index);
+            if (index >= data->size()) throw std::runtime_error("Index out of range");
+            return data->at(index);
         }
 
+        // formats in blocks (see detail::format_text) unless os is configured in a way only it reproduces
         friend std::ostream &operator<<(std::ostream &os, const MyContainer &c) {
-            for (const auto &item: c.data) os << item << " ";
+            write_walk(os, *c.data, Walk::Forward, c.parallelism);
             return os;
         }
 
@@ -68,27 +1099,15 @@ namespace containers {
 
     private:
         class Iterator {
+            friend class MyContainer;
+
         protected:
             int pos = 0;
-            std::vector<T> data;
+            View<T> data;
+            Walk walk = Walk::Forward;
 
         public:
-            explicit Iterator(MyContainer &c, const bool reverse = false) {
-                pos = 0;
-                data.clear();
-                data.reserve(c.data.size());
-                for (const auto &d: c.data) data.emplace_back(d);
-                if (reverse) std::reverse(data.begin(), data.end());
-            }
-
-            Iterator(const Iterator &other) { *this = other; }
-
-            Iterator &operator=(const Iterator &other) {
-                pos = other.pos;
-                data.clear();
-                for (const auto &v: other.data) data.push_back(v);
-                return *this;
-            }
+            Iterator(View<T> view, const Walk walk) : data(std::move(view)), walk(walk) {}
 
             virtual ~Iterator() = default;
 
@@ -98,26 +1117,22 @@ namespace containers {
             }
 
             Iterator &end() {
-                pos = data.size();
+                pos = static_cast<int>(size());
                 return *this;
             }
 
-            explicit operator bool() const { return pos < data.size(); }
-            explicit operator int() const { return pos; }
+            size_t size() const { return data->size(); }
 
-            T &operator[](const int i) {
-                const auto index = i + pos;
-                if (index >= data.size() || index < 0) throw std::out_of_range("Iterator out of range");
-                return data[index];
-            }
+            explicit operator bool() const { return pos >= 0 && static_cast<size_t>(pos) < size(); }
+            explicit operator int() const { return pos; }
 
             const T &operator[](const int i) const {
                 const auto index = i + pos;
-                if (index >= data.size() || index < 0) throw std::out_of_range("Iterator out of range");
-                return data[index];
+                if (index < 0 || static_cast<size_t>(index) >= size()) throw std::out_of_range("Iterator out of range");
+                return (*data)[walk_index(walk, index, size())];
             }
 
-            T &operator*() { return (*this)[0]; }
+            const T &operator*() const { return (*this)[0]; }
 
             auto &operator++() {
                 pos++;
@@ -141,67 +1156,188 @@ namespace containers {
                 return tmp;
             }
 
-            bool operator==(const Iterator &other) const = default;
+            // iterators over equal sequences compare equal, shared views short-circuit the element comparison
+            bool operator==(const Iterator &other) const {
+                return pos == other.pos && walk == other.walk && (data == other.data || *data == *other.data);
+            }
+
+            /* Batches */
 
-            bool operator!=(const Iterator &other) const = default;
+            // copies the next elements of the walk into out, as many as fit, and moves past them; returns how
+            // many were copied (0 at the end)
+            size_t next_batch(std::span<T> out) {
+                const size_t first = position(*this), k = std::min(out.size(), size() - first);
+                auto next = out.begin();
+                visit(*this, first, first + k, [&](const T &x) { *next++ = x; });
+                pos = static_cast<int>(first + k);
+                return k;
+            }
+
+            // Calls fn(std::span<const T>) on consecutive batches of up to batch elements, to the end of the
+            // walk. Forward walks hand out pieces of the view itself; the others gather into one buffer.
+            template<typename F>
+            void for_each_batch(F &&fn, size_t batch = 1024) {
+                batch = std::max<size_t>(batch, 1);
+                if (walk == Walk::Forward) {
+                    for (size_t first; (first = position(*this)) < size();) {
+                        const size_t k = std::min(batch, size() - first);
+                        pos = static_cast<int>(first + k);
+                        fn(std::span<const T>(data->data() + first, k));
+                    }
+                    return;
+                }
+                std::vector<T> buffer(std::min(batch, size()));
+                while (const size_t k = next_batch(buffer)) fn(std::span<const T>(buffer.data(), k));
+            }
+
+        protected:
+            // k consecutive ranges, sizes differing by at most one, covering the walk from here to its end;
+            // every range shares this iterator's view
+            template<typename Self>
+            std::vector<Range<Self>> split_as(size_t k) const {
+                k = std::max<size_t>(k, 1);
+                const size_t first = std::min<size_t>(std::max(pos, 0), size()), rest = size() - first;
+                const auto &self = static_cast<const Self &>(*this);
+                std::vector<Range<Self>> ranges(k, {self, self});
+                for (size_t j = 0; j < k; ++j) {
+                    ranges[j].first.pos = static_cast<int>(first + rest * j / k);
+                    ranges[j].last.pos = static_cast<int>(first + rest * (j + 1) / k);
+                }
+                return ranges;
+            }
         };
 
+        // calls fn(element) for positions [b, e) of order's walk
+        template<typename F>
+        static void visit(const Iterator &order, const size_t b, const size_t e, F &&fn) {
+            const auto &v = *order.data;
+            const size_t n = v.size();
+            if (order.walk == Walk::Forward) for (size_t i = b; i < e; ++i) fn(v[i]);
+            else if (order.walk == Walk::Backward) for (size_t i = b; i < e; ++i) fn(v[n - 1 - i]);
+            else for (size_t i = b; i < e; ++i) fn(v[walk_index(order.walk, i, n)]);
+        }
+
+        static size_t position(const Iterator &order) {
+            return std::min<size_t>(std::max(order.pos, 0), order.size());
+        }
+
     public:
+        /* Parallel algorithms (over an order, from its position to its end) */
+
+        // Calls fn(element) on every remaining element of order, in chunks of grain positions run on the
+        // thread pool by up to get_parallelism().threads workers; chunks run in no particular order.
+        template<typename F>
+        void parallel_for_each(const Iterator &order, F &&fn, const size_t grain = detail::walk_grain) const {
+            const size_t first = position(order);
+            parallel_for(order.size() - first, grain, parallelism.threads, [&](const size_t b, const size_t e) {
+                visit(order, first + b, first + e, fn);
+            });
+        }
+
+        // Folds transform(element) over the remaining elements of order with reduce, which must be associative
+        // (not necessarily commutative): chunks are reduced in parallel, then combined with init in walk order.
+        // The chunks do not depend on the thread count, so neither does the result.
+        template<typename R, typename Reduce, typename Transform>
+        R parallel_transform_reduce(const Iterator &order, R init, Reduce &&reduce, Transform &&transform,
+                                    size_t grain = detail::walk_grain) const {
+            grain = std::max<size_t>(grain, 1);
+            const size_t first = position(order), n = order.size() - first;
+            std::vector<std::optional<R>> partial((n + grain - 1) / grain);
+            parallel_for(n, grain, parallelism.threads, [&](const size_t b, const size_t e) {
+                for (size_t c = b / grain; c * grain < e; ++c) {
+                    auto &acc = partial[c];
+                    visit(order, first + c * grain, first + std::min(n, (c + 1) * grain), [&](const T &x) {
+                        if (acc) acc = reduce(std::move(*acc), transform(x));
+                        else acc.emplace(transform(x));
+                    });
+                }
+            });
+            for (auto &p: partial) init = reduce(std::move(init), std::move(*p));
+            return init;
+        }
+
         class Order : public Iterator {
         public:
-            explicit Order(MyContainer &c) : Iterator(c, false) {}
+            explicit Order(MyContainer &c) : Order(c.view()) {}
+
+            explicit Order(View<T> elements) : Iterator(std::move(elements), Walk::Forward) {}
+
+            std::vector<Range<Order>> split(const size_t k) const {
+                return this->template split_as<Order>(k);
+            }
         };
 
         class ReverseOrder : public Iterator {
         public:
-            explicit ReverseOrder(MyContainer &c) : Iterator(c, true) {}
+            explicit ReverseOrder(MyContainer &c) : ReverseOrder(c.view()) {}
+
+            explicit ReverseOrder(View<T> elements) : Iterator(std::move(elements), Walk::Backward) {}
+
+            std::vector<Range<ReverseOrder>> split(const size_t k) const {
+                return this->template split_as<ReverseOrder>(k);
+            }
         };
 
     private:
-        class SortedIterator : public Order {
+        // walks over a view holding the elements in ascending order
+        class SortedIterator : public Iterator {
         public:
-            explicit SortedIterator(MyContainer &c, const bool asc = true) : Order(c) {
-                sort(this->data.begin(), this->data.end());
-                if (!asc) std::reverse(this->data.begin(), this->data.end());
-            }
+            SortedIterator(View<T> sorted, const Walk walk) : Iterator(std::move(sorted), walk) {}
         };
 
     public:
         class AscendingOrder : public SortedIterator {
         public:
-            explicit AscendingOrder(MyContainer &c) : SortedIterator(c, true) {}
+            explicit AscendingOrder(MyContainer &c) : AscendingOrder(c, c.parallelism) {}
+
+            AscendingOrder(MyContainer &c, const Parallelism &p) : AscendingOrder(c.sorted_view(p)) {}
+
+            explicit AscendingOrder(View<T> sorted) : SortedIterator(std::move(sorted), Walk::Forward) {}
+
+            std::vector<Range<AscendingOrder>> split(const size_t k) const {
+                return this->template split_as<AscendingOrder>(k);
+            }
+
+        protected:
+            AscendingOrder(View<T> sorted, const Walk walk) : SortedIterator(std::move(sorted), walk) {}
         };
 
         class DescendingOrder : public SortedIterator {
         public:
-            explicit DescendingOrder(MyContainer &c) : SortedIterator(c, false) {}
+            explicit DescendingOrder(MyContainer &c) : DescendingOrder(c, c.parallelism) {}
+
+            DescendingOrder(MyContainer &c, const Parallelism &p) : DescendingOrder(c.sorted_view(p)) {}
+
+            explicit DescendingOrder(View<T> sorted) : SortedIterator(std::move(sorted), Walk::Backward) {}
+
+            std::vector<Range<DescendingOrder>> split(const size_t k) const {
+                return this->template split_as<DescendingOrder>(k);
+            }
         };
 
         class SideCrossOrder final : public AscendingOrder {
         public:
-            explicit SideCrossOrder(MyContainer &c) : AscendingOrder(c) {
-                std::vector<T> tmp;
-                const int n = this->data.size();
-                tmp.reserve(n);
-                for (size_t i = 0; i < n; ++i) {
-                    int sc_index = i % 2 == 0 ? i / 2 : n - 1 - i / 2;
-                    tmp.push_back(this->data[sc_index]);
-                }
-                this->data = std::move(tmp);
+            explicit SideCrossOrder(MyContainer &c) : SideCrossOrder(c, c.parallelism) {}
+
+            SideCrossOrder(MyContainer &c, const Parallelism &p) : SideCrossOrder(c.sorted_view(p)) {}
+
+            explicit SideCrossOrder(View<T> sorted) : AscendingOrder(std::move(sorted), Walk::SideCross) {}
+
+            std::vector<Range<SideCrossOrder>> split(const size_t k) const {
+                return this->template split_as<SideCrossOrder>(k);
             }
         };
 
         class MiddleOutOrder final : public AscendingOrder {
         public:
-            explicit MiddleOutOrder(MyContainer &c) : AscendingOrder(c) {
-                std::vector<T> tmp;
-                const int n = this->data.size(), mid = n / 2;
-                tmp.reserve(n);
-                for (int i = 0; i < n; ++i) {
-                    int mo_index = i % 2 == 0 ? mid + i / 2 : mid - i / 2 - 1;
-                    tmp.push_back(this->data[mo_index]);
-                }
-                this->data = std::move(tmp);
+            explicit MiddleOutOrder(MyContainer &c) : MiddleOutOrder(c, c.parallelism) {}
+
+            MiddleOutOrder(MyContainer &c, const Parallelism &p) : MiddleOutOrder(c.sorted_view(p)) {}
+
+            explicit MiddleOutOrder(View<T> sorted) : AscendingOrder(std::move(sorted), Walk::MiddleOut) {}
+
+            std::vector<Range<MiddleOutOrder>> split(const size_t k) const {
+                return this->template split_as<MiddleOutOrder>(k);
             }
         };
 
@@ -236,18 +1372,39 @@ namespace containers {
             return it;
         }
 
+        AscendingOrder begin_ascending_order(const Parallelism &p) {
+            auto it = AscendingOrder(*this, p);
+            it.begin();
+            return it;
+        }
+
         AscendingOrder end_ascending_order() {
             auto it = AscendingOrder(*this);
             it.end();
             return it;
         }
 
+        // ascending order over the sorted view prepare_sorted_async() builds
+        std::future<AscendingOrder> ascending_async() const {
+            return std::async(std::launch::deferred, [sorting = sorted_view_async(), source = source] {
+                auto it = AscendingOrder(share(detail::await(sorting), source));
+                it.begin();
+                return it;
+            });
+        }
+
         DescendingOrder begin_descending_order() {
             auto it = DescendingOrder(*this);
             it.begin();
             return it;
         }
 
+        DescendingOrder begin_descending_order(const Parallelism &p) {
+            auto it = DescendingOrder(*this, p);
+            it.begin();
+            return it;
+        }
+
         DescendingOrder end_descending_order() {
             auto it = DescendingOrder(*this);
             it.end();
@@ -260,6 +1417,12 @@ namespace containers {
             return it;
         }
 
+        SideCrossOrder begin_side_cross_order(const Parallelism &p) {
+            auto it = SideCrossOrder(*this, p);
+            it.begin();
+            return it;
+        }
+
         SideCrossOrder end_side_cross_order() {
             auto it = SideCrossOrder(*this);
             it.end();
@@ -272,6 +1435,12 @@ namespace containers {
             return it;
         }
 
+        MiddleOutOrder begin_middle_out_order(const Parallelism &p) {
+            auto it = MiddleOutOrder(*this, p);
+            it.begin();
+            return it;
+        }
+
         MiddleOutOrder end_middle_out_order() {
             auto it = MiddleOutOrder(*this);
             it.end();
@@ -279,10 +1448,20 @@ namespace containers {
         }
     };
 
+    // Appends the values written in text, in order: numbers (as std::from_chars reads them, plus an optional
+    // '+') or strings separated by whitespace, or every non-whitespace byte for char. Parses in pieces on the
+    // pool when the container's parallelism applies to the size of the text. For std::string_view the elements
+    // are the tokens themselves, pointing into text: pass its owner to c.keep_alive unless it outlives c.
+    template<detail::text_parsable T>
+    void parse_into(MyContainer<T> &c, const std::string_view text) {
+        c.add_all(detail::parse_text<T>(text, c.get_parallelism()));
+    }
+
     template class MyContainer<int>;
     template class MyContainer<double>;
     template class MyContainer<char>;
     template class MyContainer<std::string>;
+    template class MyContainer<std::string_view>;
 } // namespace containers
 
 
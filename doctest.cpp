@@ -1,10 +1,92 @@
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 
 #include "doctest.hpp"
+#include "concurrent.hpp"
 #include "containers.hpp"
+#include "frontcoded.hpp"
+#include "mapped.hpp"
+#include "oplog.hpp"
+#include "packed.hpp"
+#include "persistent.hpp"
+#include "sharded.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <malloc.h>
+#include <new>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <sys/wait.h>
+#include <unistd.h>
 
 using namespace containers;
 
+// Heap use while an AllocationProbe is alive (every thread counts): the peak of the bytes allocated since it
+// started and not freed yet.
+namespace {
+    std::atomic<bool> probing{false};
+    std::atomic<long long> live_bytes{0}, peak_bytes{0};
+}
+
+struct AllocationProbe {
+    AllocationProbe() {
+        live_bytes = peak_bytes = 0;
+        probing = true;
+    }
+
+    ~AllocationProbe() { probing = false; }
+
+    static long long peak() { return peak_bytes; }
+};
+
+void *operator new(const size_t n) {
+    void *p = std::malloc(n ? n : 1);
+    if (!p) throw std::bad_alloc();
+    if (probing.load(std::memory_order_relaxed)) {
+        const long long now = live_bytes += static_cast<long long>(malloc_usable_size(p));
+        for (long long peak = peak_bytes; now > peak && !peak_bytes.compare_exchange_weak(peak, now);) {}
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    if (p && probing.load(std::memory_order_relaxed)) live_bytes -= static_cast<long long>(malloc_usable_size(p));
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+
+template<typename T>
+std::vector<T> random_keys(const size_t n, const int range, const unsigned seed) {
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution dist(-range, range);
+    std::vector<T> v(n);
+    for (auto &x: v) x = static_cast<T>(dist(gen)) / (std::is_integral_v<T> ? 1 : 4);
+    return v;
+}
+
+// the elements from it to the end of its walk, collected as V (the element type by default)
+template<typename V = void, typename It>
+auto walk(It it) {
+    std::vector<std::conditional_t<std::is_void_v<V>, std::remove_cvref_t<decltype(*it)>, V>> out;
+    for (; it; ++it) out.emplace_back(*it);
+    return out;
+}
+
+// a file in the temp directory, with nothing left there by an earlier run
+std::string temp_path(const std::string &name) {
+    const auto path = (std::filesystem::temp_directory_path() / name).string();
+    std::filesystem::remove(path);
+    return path;
+}
+
 
 TEST_CASE("operations") {
     // Create a container and check its initial state
@@ -29,6 +111,19 @@ TEST_CASE("operations") {
     CHECK_THROWS(c.remove(100));
 }
 
+TEST_CASE("search") {
+    MyContainer<char> c;
+    for (const char ch: std::string("mississippi")) c.add(ch);
+    CHECK(c.contains('p'));
+    CHECK_FALSE(c.contains('x'));
+    CHECK(c.count('s') == 4);
+
+    CHECK(c.try_remove('s') == 4);
+    CHECK(c.try_remove('s') == 0);
+    CHECK(c.size() == 7);
+    CHECK(c[2] == 'i');
+}
+
 TEST_CASE("Copy, =") {
     // Test copy constructor
     MyContainer<int> a;
@@ -48,6 +143,95 @@ TEST_CASE("Copy, =") {
     CHECK(c[1] == 2);
 }
 
+TEST_CASE("copy on write") {
+    MyContainer<int> a;
+    a.add(3);
+    a.add(1);
+    const auto sorted = a.sorted_elements();
+    MyContainer<int> b = a;
+    // copies share the elements and the cached sorted index
+    CHECK(b.elements() == a.elements());
+    CHECK(b.sorted_elements() == sorted);
+
+    auto it = b.begin_order();
+    b.add(2); // detaches b from a and from the iterator
+    CHECK(a.size() == 2);
+    CHECK(it.size() == 2);
+    CHECK(b.elements() != a.elements());
+    CHECK(a.sorted_elements() == sorted);
+    CHECK(*b.begin_descending_order() == 3);
+
+    MyContainer<int> c = a;
+    CHECK(c.try_remove(42) == 0);
+    CHECK(c.elements() == a.elements());
+    c[0] = 7;
+    CHECK(std::as_const(a)[0] == 3);
+    CHECK(c.max() == 7);
+}
+
+TEST_CASE("element writes never reach shared storage") {
+    MyContainer<int> c;
+    c.add(2);
+    c.add(1);
+    auto r = c[0];
+    const MyContainer<int> d = c;
+    auto it = c.begin_order();
+    CHECK(c.max() == 2);
+    r = 100;
+    CHECK(d[0] == 2);
+    CHECK(*it == 2);
+    CHECK(c.max() == 100);
+    CHECK(c[0] == 100);
+    c[1] = c[0];
+    CHECK(c.sum() == 200);
+    static_assert(!std::is_reference_v<decltype(c[0])>);
+
+    const MyContainer<int> e = c;
+    c[0] += 5;
+    c[1] -= 1;
+    CHECK(c.sum() == 204);
+    swap(c[0], c[1]);
+    CHECK((c[0] == 99 && c[1] == 105));
+    CHECK((e[0] == 100 && e[1] == 100));
+
+    MyContainer<std::string> s;
+    s.add("pear");
+    const auto copy = s;
+    s[0] = "plum";
+    s[0] += "s";
+    CHECK(s[0] == "plums");
+    CHECK(s[0]->size() == 5);
+    CHECK(copy[0] == "pear");
+}
+
+TEST_CASE("aggregates") {
+    MyContainer<int> c;
+    CHECK_THROWS(c.min());
+    CHECK_THROWS(c.mean());
+    CHECK(c.sum() == 0);
+
+    for (const int x: {4, -2, 9, 1, 3}) c.add(x);
+    CHECK(c.min() == -2);
+    CHECK(c.max() == 9);
+    CHECK(c.minmax() == std::pair{-2, 9});
+    CHECK(c.sum() == 15);
+    CHECK(c.mean() == doctest::Approx(3.0));
+    CHECK(c.variance() == doctest::Approx(13.2));
+
+    // the cache follows modifications
+    c.add(20);
+    CHECK(c.max() == 20);
+    c.remove(-2);
+    CHECK(c.min() == 1);
+    c[0] = 100;
+    CHECK(c.sum() == 133);
+
+    MyContainer<std::string> s;
+    s.add("pear");
+    s.add("apple");
+    CHECK(s.minmax() == std::pair<std::string, std::string>{"apple", "pear"});
+}
+
 TEST_SUITE("Iterators") {
     TEST_CASE("Iterator - Order") {
         // Iterates over elements in the order they were added
@@ -137,4 +321,1336 @@ TEST_SUITE("Iterators") {
         // Expected
         CHECK(out == std::vector{3, 2, 4, 1, 5});
     }
+}
+
+TEST_SUITE("Sorting") {
+    template<typename T>
+    void check_simd_sort(std::vector<T> v) {
+        auto expected = v;
+        std::sort(expected.begin(), expected.end());
+        simd::sort(v.data(), v.size());
+        CHECK(v == expected);
+    }
+
+    TEST_CASE_TEMPLATE("SIMD sort matches std::sort", T, int, float, double) {
+        for (const auto l: {simd::Level::Scalar, simd::Level::AVX2, simd::Level::AVX512}) {
+            if (l > simd::detected()) continue;
+            simd::set_level(l);
+            CAPTURE(static_cast<int>(l));
+            for (const size_t n: {0, 1, 7, 8, 9, 25, 100, 1000, 4097, 50000}) {
+                check_simd_sort(random_keys<T>(n, 1 << 20, n)); // mostly distinct
+                check_simd_sort(random_keys<T>(n, 3, n)); // heavy duplicates
+                auto v = random_keys<T>(n, 1 << 20, n + 1);
+                std::sort(v.begin(), v.end());
+                check_simd_sort(v); // already sorted
+                std::reverse(v.begin(), v.end());
+                check_simd_sort(v); // reversed
+                check_simd_sort(std::vector<T>(n, T(7))); // all equal
+            }
+        }
+        simd::set_level(simd::Level::AVX512);
+    }
+
+    TEST_CASE("Sorted orders use the SIMD kernel") {
+        MyContainer<double> c;
+        auto keys = random_keys<double>(3000, 1000, 42);
+        for (const auto k: keys) c.add(k);
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<double> asc, desc;
+        for (auto it = c.begin_ascending_order(); it; ++it) asc.push_back(*it);
+        for (auto it = c.begin_descending_order(); it; ++it) desc.push_back(*it);
+
+        CHECK(asc == keys);
+        std::reverse(keys.begin(), keys.end());
+        CHECK(desc == keys);
+    }
+
+    TEST_CASE_TEMPLATE("Parallel sort is deterministic", T, int, double) {
+        const auto keys = random_keys<T>(100000, 5000, 7);
+        auto expected = keys;
+        std::sort(expected.begin(), expected.end());
+        for (const size_t threads: {1, 2, 3, 8, 32}) {
+            CAPTURE(threads);
+            auto v = keys;
+            parallel_sort(v.data(), v.size(), threads, detail::sort_run<T>);
+            CHECK(v == expected);
+        }
+    }
+
+    TEST_CASE("String prefix sort matches std::sort") {
+        std::mt19937 gen(9);
+        std::uniform_int_distribution pick(0, 5), len(0, 24);
+        const std::string roots[] = {"https://example.com/", "https://example.org/a", "id_", "", std::string("x\0", 2)};
+        std::vector<std::string> v;
+        for (int i = 0; i < 5000; ++i) {
+            std::string s = roots[pick(gen) % 5];
+            for (int j = len(gen); j > 0; --j) s += static_cast<char>("ab\0\xff/"[pick(gen) % 5]);
+            v.push_back(s);
+        }
+        auto expected = v;
+        std::sort(expected.begin(), expected.end());
+        detail::sort_strings(v.data(), v.size());
+        CHECK(v == expected);
+    }
+
+    TEST_CASE("Parallelism per container and per call") {
+        MyContainer<std::string> c;
+        std::vector<std::string> keys;
+        for (const auto k: random_keys<int>(20000, 3000, 11)) {
+            keys.push_back(std::to_string(k));
+            c.add(keys.back());
+        }
+        std::sort(keys.begin(), keys.end());
+
+        c.set_parallelism({4, 1000});
+        CHECK(c.get_parallelism().threads == 4);
+        std::vector<std::string> asc;
+        for (auto it = c.begin_ascending_order(); it; ++it) asc.push_back(*it);
+        CHECK(asc == keys);
+
+        std::vector<std::string> desc;
+        for (auto it = c.begin_descending_order({3, 1}); it; ++it) desc.push_back(*it);
+        std::reverse(keys.begin(), keys.end());
+        CHECK(desc == keys);
+    }
+
+    TEST_CASE("Generators yield every order lazily") {
+        for (const size_t n: {0, 1, 2, 5, 1000, 1001}) {
+            MyContainer<int> c;
+            for (const int k: random_keys<int>(n, 100, n)) c.add(k);
+            const auto check = [&](Generator<int> generated, auto it) {
+                std::vector<int> expected, actual;
+                for (; it; ++it) expected.push_back(*it);
+                for (const int x: generated) actual.push_back(x);
+                CHECK(actual == expected);
+            };
+            for (int pass = 0; pass < 2; ++pass) { // selection heaps first, then the cached sorted view
+                check(c.generate_order(), c.begin_order());
+                check(c.generate_reverse_order(), c.begin_reverse_order());
+                check(c.generate_ascending_order(), c.begin_ascending_order());
+                check(c.generate_descending_order(), c.begin_descending_order());
+                check(c.generate_side_cross_order(), c.begin_side_cross_order());
+                check(c.generate_middle_out_order(), c.begin_middle_out_order());
+            }
+        }
+
+        MyContainer<std::string> c;
+        for (const auto *s: {"delta", "alpha", "charlie", "bravo"}) c.add(s);
+        auto smallest = c.generate_ascending_order();
+        c.add("aardvark"); // the generator keeps the elements it started with
+        std::vector<std::string> first;
+        for (const auto &x: smallest) {
+            first.push_back(x);
+            if (first.size() == 2) break;
+        }
+        CHECK(first == std::vector<std::string>{"alpha", "bravo"});
+    }
+
+    TEST_CASE("Batches cover every order") {
+        MyContainer<int> c;
+        for (const int k: random_keys<int>(3000, 500, 8)) c.add(k);
+        PersistentContainer<int> p;
+        for (auto it = c.begin_order(); it; ++it) p = p.add(*it);
+        ShardedContainer<int> sharded(3);
+        for (auto it = c.begin_order(); it; ++it) sharded.add(*it);
+
+        const auto check = [](auto it, auto reference) {
+            std::vector<int> expected, batched, spans;
+            for (; reference; ++reference) expected.push_back(*reference);
+            auto copy = it;
+            std::array<int, 100> out{};
+            while (const size_t k = copy.next_batch(out)) batched.insert(batched.end(), out.begin(), out.begin() + k);
+            CHECK(batched == expected);
+            CHECK_FALSE(copy);
+            it.for_each_batch([&](std::span<const int> batch) {
+                CHECK(batch.size() <= 256);
+                spans.insert(spans.end(), batch.begin(), batch.end());
+            }, 256);
+            CHECK(spans == expected);
+        };
+        check(c.begin_order(), c.begin_order());
+        check(c.begin_reverse_order(), c.begin_reverse_order());
+        check(c.begin_ascending_order(), c.begin_ascending_order());
+        check(c.begin_descending_order(), c.begin_descending_order());
+        check(c.begin_side_cross_order(), c.begin_side_cross_order());
+        check(c.begin_middle_out_order(), c.begin_middle_out_order());
+        check(p.begin_order(), c.begin_order());
+        check(p.begin_reverse_order(), c.begin_reverse_order());
+        check(sharded.begin_middle_out_order(), c.begin_middle_out_order());
+    }
+
+    TEST_CASE("Sorted views built in the background") {
+        MyContainer<int> c;
+        auto keys = random_keys<int>(50000, 1 << 20, 21);
+        for (const int k: keys) c.add(k);
+        std::sort(keys.begin(), keys.end());
+
+        const auto sorting = c.prepare_sorted_async();
+        c.add(-(1 << 22)); // does not disturb the sort under way
+        CHECK(*sorting.get() == keys);
+
+        auto ascending = c.ascending_async();
+        const auto it = ascending.get();
+        CHECK(*it == -(1 << 22));
+        CHECK(it.size() == keys.size() + 1);
+        CHECK(c.sorted_elements() == c.prepare_sorted_async().get()); // one index per generation
+
+        c.set_auto_presort(true, 1000, 1);
+        c.remove(-(1 << 22));
+        CHECK(c.contains(keys[7])); // first read after the change starts the re-sort
+        const auto asc = walk(c.begin_ascending_order());
+        CHECK(asc == keys);
+    }
+
+    TEST_CASE("Reads between writes do not presort") {
+        MyContainer<int> c;
+        for (const int k: random_keys<int>(5000, 1 << 20, 37)) c.add(k);
+        c.set_auto_presort(true, 1000, 3);
+        // a sort under way would hold the storage too, making every add copy it; the keys are all new, so
+        // every read is followed by a write
+        for (int x = 1 << 21; x < (1 << 21) + 200; ++x) {
+            if (!c.contains(x)) c.add(x);
+            CHECK(c.elements().use_count() == 2);
+        }
+        CHECK(c.size() > 5000);
+        for (int i = 0; i < 3; ++i) c.count(1); // settled: the third read in a row starts it
+        const auto asc = walk(c.begin_ascending_order());
+        CHECK(std::is_sorted(asc.begin(), asc.end()));
+    }
+}
+
+TEST_SUITE("Parallel") {
+    TEST_CASE("parallel_for covers every index once") {
+        std::vector<std::atomic<int>> hits(10007);
+        parallel_for(hits.size(), 64, 8, [&](const size_t b, const size_t e) {
+            for (size_t i = b; i < e; ++i) hits[i]++;
+        });
+        CHECK(std::all_of(hits.begin(), hits.end(), [](const auto &h) { return h.load() == 1; }));
+    }
+
+    TEST_CASE("TaskGroup rethrows task exceptions") {
+        TaskGroup group;
+        std::atomic<int> done{0};
+        for (int i = 0; i < 16; ++i)
+            group.run([&, i] {
+                if (i == 5) throw std::runtime_error("task failed");
+                done++;
+            });
+        CHECK_THROWS_AS(group.wait(), std::runtime_error);
+        CHECK(done == 15);
+    }
+
+    TEST_CASE("parallel_for_each and parallel_transform_reduce follow the order") {
+        MyContainer<int> c;
+        for (const int k: random_keys<int>(5000, 1000, 3)) c.add(k);
+        c.set_parallelism({4, 0});
+        const auto check = [&](auto it) {
+            std::vector<int> expected;
+            for (auto e = it; e; ++e) expected.push_back(*e);
+
+            std::atomic<long long> sum{0};
+            std::atomic<size_t> calls{0};
+            c.parallel_for_each(it, [&](const int x) {
+                sum += x;
+                calls++;
+            }, 64);
+            CHECK(calls == expected.size());
+            CHECK(sum == std::accumulate(expected.begin(), expected.end(), 0LL));
+
+            // concatenation is associative but not commutative, so this checks the walk order
+            const auto joined = c.parallel_transform_reduce(it, std::string(), std::plus<>(), [](const int x) {
+                return std::to_string(x) + ",";
+            }, 100);
+            std::string serial;
+            for (const int x: expected) serial += std::to_string(x) + ",";
+            CHECK(joined == serial);
+        };
+        check(c.begin_order());
+        check(c.begin_reverse_order());
+        check(c.begin_ascending_order());
+        check(c.begin_descending_order());
+        check(c.begin_side_cross_order());
+        check(++++c.begin_middle_out_order());
+        check(c.end_order());
+    }
+
+    TEST_CASE("Split orders cover the walk and share its view") {
+        MyContainer<int> c;
+        for (const int k: random_keys<int>(1001, 100, 5)) c.add(k);
+        const auto check = [&](auto it, const size_t k) {
+            std::vector<int> whole, pieces;
+            for (auto e = it; e; ++e) whole.push_back(*e);
+            const auto ranges = it.split(k);
+            REQUIRE(ranges.size() == k);
+            for (const auto &r: ranges) {
+                CHECK(r.size() + 1 >= whole.size() / k);
+                if (r.size()) CHECK(&*r.first == &it[static_cast<int>(r.first) - static_cast<int>(it)]); // no copy
+                for (const int x: r) pieces.push_back(x);
+            }
+            CHECK(pieces == whole);
+        };
+        for (const size_t k: {1, 3, 32, 2000}) {
+            check(c.begin_order(), k);
+            check(c.begin_reverse_order(), k);
+            check(c.begin_ascending_order(), k);
+            check(c.begin_descending_order(), k);
+            check(c.begin_side_cross_order(), k);
+            auto middle_out = c.begin_middle_out_order();
+            ++middle_out;
+            check(middle_out, k);
+        }
+
+        // consumed on separate threads
+        const auto ranges = c.begin_ascending_order().split(4);
+        std::vector<long long> sums(4);
+        std::vector<std::thread> threads;
+        for (size_t j = 0; j < 4; ++j)
+            threads.emplace_back([&, j] {
+                for (const int x: ranges[j]) sums[j] += x;
+            });
+        for (auto &t: threads) t.join();
+        CHECK(std::accumulate(sums.begin(), sums.end(), 0LL) == c.sum());
+    }
+}
+
+TEST_SUITE("Search kernels") {
+    template<typename T>
+    void check_search_kernels(const size_t n, const unsigned seed) {
+        std::mt19937 gen(seed);
+        std::uniform_int_distribution dist(0, 5);
+        std::vector<T> v(n);
+        for (auto &x: v) x = static_cast<T>('a' + dist(gen));
+        for (const T key: {T('a'), T('c'), T('z')}) {
+            CHECK(simd::find(v.data(), n, key) == static_cast<size_t>(std::find(v.begin(), v.end(), key) - v.begin()));
+            CHECK(simd::count(v.data(), n, key) == static_cast<size_t>(std::count(v.begin(), v.end(), key)));
+            auto expected = v, actual = v;
+            expected.erase(std::remove(expected.begin(), expected.end(), key), expected.end());
+            actual.resize(simd::remove(actual.data(), n, key));
+            CHECK(actual == expected);
+        }
+    }
+
+    TEST_CASE_TEMPLATE("find, count and remove match the standard algorithms", T, int, double, char) {
+        for (const auto l: {simd::Level::Scalar, simd::Level::AVX2, simd::Level::AVX512}) {
+            if (l > simd::detected()) continue;
+            simd::set_level(l);
+            CAPTURE(static_cast<int>(l));
+            for (const size_t n: {0, 1, 31, 32, 33, 64, 65, 1000, 4099}) check_search_kernels<T>(n, n);
+        }
+        simd::set_level(simd::Level::AVX512);
+    }
+}
+
+TEST_SUITE("Reductions") {
+    TEST_CASE_TEMPLATE("SIMD reductions match scalar ones", T, int, double, char) {
+        std::mt19937 gen(3);
+        std::uniform_int_distribution dist(-100, 100);
+        for (const size_t n: {1, 3, 31, 64, 65, 1000, 70001}) {
+            CAPTURE(n);
+            std::vector<T> v(n);
+            for (auto &x: v) x = static_cast<T>(dist(gen)) / (std::is_integral_v<T> ? 1 : 8);
+            const auto [lo, hi] = std::minmax_element(v.begin(), v.end());
+            double expected_sum = 0;
+            for (const auto x: v) expected_sum += x;
+            const double mean = expected_sum / n;
+            double expected_sq = 0;
+            for (const auto x: v) expected_sq += (x - mean) * (x - mean);
+
+            for (const auto l: {simd::Level::Scalar, simd::Level::AVX2, simd::Level::AVX512}) {
+                if (l > simd::detected()) continue;
+                simd::set_level(l);
+                T min, max;
+                simd::minmax(v.data(), n, min, max);
+                CHECK(min == *lo);
+                CHECK(max == *hi);
+                CHECK(static_cast<double>(simd::sum(v.data(), n)) == doctest::Approx(expected_sum));
+                CHECK(simd::squared_deviations(v.data(), n, mean) == doctest::Approx(expected_sq));
+            }
+            simd::set_level(simd::Level::AVX512);
+        }
+    }
+
+    TEST_CASE("Aggregates do not depend on the thread count") {
+        MyContainer<double> a, b;
+        for (const auto x: random_keys<double>(300000, 1 << 20, 5)) {
+            a.add(x * 1e-3);
+            b.add(x * 1e-3);
+        }
+        a.set_parallelism({1, 1});
+        b.set_parallelism({6, 1});
+        CHECK(a.sum() == b.sum());
+        CHECK(a.variance() == b.variance());
+        CHECK(a.minmax() == b.minmax());
+    }
+}
+
+TEST_SUITE("Concurrent") {
+    TEST_CASE("Snapshots are isolated from later writes") {
+        ConcurrentContainer<int> c;
+        c.add(3);
+        c.add(1);
+        const auto before = c.snapshot();
+        c.add(2);
+        c.remove(3);
+        CHECK_FALSE(c.try_remove(42));
+
+        std::vector<int> old, now;
+        for (auto it = before.begin_ascending_order(); it != before.end_ascending_order(); ++it) old.push_back(*it);
+        const auto after = c.snapshot();
+        for (auto it = after.begin_descending_order(); it; ++it) now.push_back(*it);
+        CHECK(old == std::vector{1, 3});
+        CHECK(now == std::vector{2, 1});
+        CHECK(c.size() == 2);
+    }
+
+    TEST_CASE("Readers see consistent versions while writers run") {
+        ConcurrentContainer<int> c;
+        std::atomic<bool> done{false};
+        std::atomic<int> bad{0};
+        std::vector<std::thread> threads;
+        for (int r = 0; r < 3; ++r)
+            threads.emplace_back([&] {
+                while (!done) {
+                    const auto s = c.snapshot();
+                    std::vector<int> asc;
+                    for (auto it = s.begin_ascending_order(); it; ++it) asc.push_back(*it);
+                    if (asc.size() != s.size() || !std::is_sorted(asc.begin(), asc.end())) bad++;
+                }
+            });
+        std::vector<std::thread> writers;
+        for (int w = 0; w < 4; ++w)
+            writers.emplace_back([&, w] {
+                for (int i = 0; i < 200; ++i) c.add(w * 1000 + i);
+            });
+        for (auto &t: writers) t.join();
+        done = true;
+        for (auto &t: threads) t.join();
+
+        CHECK(bad == 0);
+        CHECK(c.size() == 800);
+    }
+
+    TEST_CASE("Producers append lock-free and fold in batches") {
+        ConcurrentContainer<int> c;
+        c.set_fold_threshold(1000);
+        std::vector<std::thread> producers;
+        for (int p = 0; p < 4; ++p)
+            producers.emplace_back([&, p] {
+                auto producer = c.producer(64);
+                for (int i = 0; i < 5000; ++i) producer.add(p * 100000 + i);
+            });
+        producers.emplace_back([&] {
+            for (int i = 0; i < 5000; ++i) c.ingest(-1 - i);
+        });
+        for (auto &t: producers) t.join();
+        CHECK(c.size() > 0); // automatic folds ran
+        c.flush();
+        CHECK(c.flush() == 0);
+
+        const auto s = c.snapshot();
+        REQUIRE(s.size() == 25000);
+        // every producer's appends keep their order
+        std::vector<int> last(5, -1);
+        bool ordered = true;
+        for (auto it = s.begin_order(); it; ++it) {
+            const int p = *it < 0 ? 4 : *it / 100000, i = *it < 0 ? -1 - *it : *it % 100000;
+            ordered &= i == last[p] + 1;
+            last[p] = i;
+        }
+        CHECK(ordered);
+    }
+
+    TEST_CASE("Writers see pending appends") {
+        ConcurrentContainer<int> c;
+        c.ingest(7);
+        CHECK(c.size() == 0);
+        c.remove(7);
+        CHECK(c.size() == 0);
+        CHECK(c.flush() == 0);
+    }
+}
+
+TEST_SUITE("Sharded") {
+    TEST_CASE("Sharded orders match a single container") {
+        using Sharding = ShardedContainer<int>::Sharding;
+        for (const auto sharding: {Sharding::Thread, Sharding::Hash})
+            for (const size_t n: {0, 1, 2, 7, 1000, 1001}) {
+                ShardedContainer<int> sharded(5, sharding);
+                MyContainer<int> single;
+                const auto keys = random_keys<int>(n, 50, n);
+                std::vector<std::thread> writers;
+                for (size_t w = 0; w < 3; ++w)
+                    writers.emplace_back([&, w] {
+                        for (size_t i = w; i < n; i += 3) sharded.add(keys[i]);
+                    });
+                for (auto &t: writers) t.join();
+                for (const int k: keys) single.add(k);
+
+                CHECK(sharded.size() == n);
+                CHECK(walk(sharded.begin_ascending_order()) == walk(single.begin_ascending_order()));
+                CHECK(walk(sharded.begin_descending_order()) == walk(single.begin_descending_order()));
+                CHECK(walk(sharded.begin_side_cross_order()) == walk(single.begin_side_cross_order()));
+                CHECK(walk(sharded.begin_middle_out_order()) == walk(single.begin_middle_out_order()));
+
+                auto order = walk(sharded.begin_order());
+                auto reverse = walk(sharded.begin_reverse_order());
+                std::reverse(reverse.begin(), reverse.end());
+                CHECK(order == reverse);
+                std::sort(order.begin(), order.end());
+                CHECK(order == walk(single.begin_ascending_order()));
+            }
+    }
+
+    template<typename It, typename Single>
+    void check_backwards(It end, Single single) {
+        const auto expected = walk(single);
+        std::vector<int> back;
+        while (static_cast<int>(end) > 0) back.push_back(*--end);
+        std::reverse(back.begin(), back.end());
+        CHECK(back == expected);
+        for (size_t i = 0; i < expected.size(); i += 7) CHECK(end[static_cast<int>(i)] == expected[i]);
+    }
+
+    TEST_CASE("Sharded orders go back and read at offsets") {
+        ShardedContainer<int> sharded(4, ShardedContainer<int>::Sharding::Hash);
+        MyContainer<int> single;
+        for (const int k: random_keys<int>(600, 40, 31)) {
+            sharded.add(k);
+            single.add(k);
+        }
+        check_backwards(sharded.end_ascending_order(), single.begin_ascending_order());
+        check_backwards(sharded.end_descending_order(), single.begin_descending_order());
+        check_backwards(sharded.end_side_cross_order(), single.begin_side_cross_order());
+        check_backwards(sharded.end_middle_out_order(), single.begin_middle_out_order());
+        auto it = sharded.begin_ascending_order();
+        for (int i = 0; i < 300; ++i) ++it;
+        --it;
+        ++it;
+        CHECK(*it == single.begin_ascending_order()[300]);
+        CHECK(it[-300] == single.begin_ascending_order()[0]);
+    }
+
+    TEST_CASE("Sharded modify and search") {
+        ShardedContainer<std::string> c(3, ShardedContainer<std::string>::Sharding::Hash);
+        c.add("b");
+        c.add("a");
+        c.add("b");
+        CHECK(c.count("b") == 2);
+        CHECK(c.try_remove("b") == 2);
+        CHECK_FALSE(c.contains("b"));
+        CHECK_THROWS_AS(c.remove("z"), std::runtime_error);
+        CHECK(*c.begin_ascending_order() == "a");
+        CHECK_THROWS_AS(*c.end_middle_out_order(), std::out_of_range);
+    }
+}
+
+TEST_SUITE("Persistent") {
+    TEST_CASE("Every version keeps its elements and orders") {
+        std::vector<PersistentContainer<int>> versions(1);
+        std::vector<MyContainer<int>> expected(1);
+        const auto keys = random_keys<int>(10000, 300, 11);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto c = expected.back();
+            if (i % 50 == 49) {
+                versions.push_back(versions.back().try_remove(keys[i]));
+                c.try_remove(keys[i]);
+            } else {
+                versions.push_back(versions.back().add(keys[i]));
+                c.add(keys[i]);
+            }
+            expected.push_back(c);
+        }
+        for (size_t v = 0; v < versions.size(); v += 997) {
+            auto &p = versions[v];
+            auto &c = expected[v];
+            REQUIRE(p.size() == c.size());
+            CHECK(walk(p.begin_order()) == walk(c.begin_order()));
+            CHECK(walk(p.begin_reverse_order()) == walk(c.begin_reverse_order()));
+            CHECK(walk(p.begin_ascending_order()) == walk(c.begin_ascending_order()));
+            CHECK(walk(p.begin_descending_order()) == walk(c.begin_descending_order()));
+            CHECK(walk(p.begin_side_cross_order()) == walk(c.begin_side_cross_order()));
+            CHECK(walk(p.begin_middle_out_order()) == walk(c.begin_middle_out_order()));
+            if (p.size()) CHECK(p[p.size() / 2] == std::as_const(c)[c.size() / 2]);
+        }
+    }
+
+    TEST_CASE("Persistent remove") {
+        const auto a = PersistentContainer<int>().add(1).add(2).add(1);
+        const auto b = a.remove(1);
+        CHECK(a.size() == 3);
+        CHECK(b.size() == 1);
+        CHECK(b[0] == 2);
+        CHECK_THROWS_AS((void) b.remove(1), std::runtime_error);
+        CHECK(b.remove(2).size() == 0);
+        CHECK(b.remove(2).begin_order() == b.remove(2).end_order());
+        auto it = a.begin_order();
+        it++;
+        CHECK(*it == 2);
+        CHECK(it[-1] == 1);
+        CHECK_THROWS_AS(it[5], std::out_of_range);
+    }
+}
+
+TEST_SUITE("Snapshots") {
+    template<typename T>
+    std::vector<T> elements(const MyContainer<T> &c) {
+        return *c.elements();
+    }
+
+    TEST_CASE_TEMPLATE("Binary save and load round trip", T, int, double, char, float) {
+        MyContainer<T> c;
+        for (const T k: random_keys<T>(10000, 100, 4)) c.add(k);
+        std::stringstream stream;
+        c.save(stream);
+        CHECK(elements(MyContainer<T>::load(stream)) == elements(c));
+
+        std::stringstream empty;
+        MyContainer<T>().save(empty);
+        CHECK(MyContainer<T>::load(empty).size() == 0);
+    }
+
+    TEST_CASE("Strings are saved as lengths and one blob") {
+        MyContainer<std::string> c;
+        for (const auto *s: {"", "a", "hello world", "tab\there"}) c.add(s);
+        c.add(std::string(1000, 'x'));
+        const auto path = temp_path("containers_snapshot_test.bin");
+        c.save(path);
+        CHECK(elements(MyContainer<std::string>::load(path)) == elements(c));
+        std::filesystem::remove(path);
+        CHECK_THROWS_AS(MyContainer<std::string>::load(path), std::runtime_error);
+    }
+
+    TEST_CASE("Snapshots may carry the sorted index") {
+        MyContainer<std::string> strings;
+        for (const auto k: random_keys<int>(2000, 500, 9)) strings.add(std::to_string(k));
+        std::stringstream stream;
+        strings.save(stream, true);
+        auto loaded = MyContainer<std::string>::load(stream);
+        CHECK(elements(loaded) == elements(strings));
+        CHECK(*loaded.sorted_elements() == *strings.sorted_elements());
+        std::vector<std::string> mo, expected;
+        for (auto it = loaded.begin_middle_out_order(); it; ++it) mo.push_back(*it);
+        for (auto it = strings.begin_middle_out_order(); it; ++it) expected.push_back(*it);
+        CHECK(mo == expected);
+
+        MyContainer<int> c;
+        for (const int k: {5, 3, 9, 1}) c.add(k);
+        std::stringstream ints;
+        c.save(ints, true);
+        const auto bytes = ints.str();
+        const size_t sorted_at = bytes.size() - 4 * sizeof(int);
+        const auto tampered = [&](const size_t at, const int value) {
+            auto copy = bytes;
+            std::memcpy(copy.data() + at, &value, sizeof(int));
+            std::stringstream in(copy);
+            return in;
+        };
+        auto ok = tampered(sorted_at, 1);
+        CHECK(*MyContainer<int>::load(ok).begin_descending_order() == 9);
+        auto unsorted = tampered(sorted_at, 10);
+        CHECK_THROWS_AS(MyContainer<int>::load(unsorted), std::runtime_error);
+        auto other = tampered(sorted_at, 0);
+        CHECK_THROWS_AS(MyContainer<int>::load(other), std::runtime_error);
+    }
+
+    TEST_CASE("Corrupt snapshots are rejected") {
+        MyContainer<int> c;
+        c.add(1);
+        c.add(2);
+        std::stringstream stream;
+        c.save(stream);
+        const auto bytes = stream.str();
+
+        std::stringstream truncated(bytes.substr(0, bytes.size() - 1));
+        CHECK_THROWS_AS(MyContainer<int>::load(truncated), std::runtime_error);
+        std::stringstream other_type(bytes);
+        CHECK_THROWS_AS(MyContainer<float>::load(other_type), std::runtime_error);
+        std::stringstream garbage("not a snapshot at all, just text");
+        CHECK_THROWS_AS(MyContainer<int>::load(garbage), std::runtime_error);
+    }
+
+    // a stream that cannot seek, so it cannot tell how much it holds
+    struct OneWay : std::streambuf {
+        std::string bytes;
+
+        explicit OneWay(std::string b) : bytes(std::move(b)) {
+            setg(bytes.data(), bytes.data(), bytes.data() + bytes.size());
+        }
+    };
+
+    TEST_CASE_TEMPLATE("Huge counts fail before allocating", T, int, std::string) {
+        MyContainer<T> c;
+        c.add(T());
+        std::stringstream stream;
+        c.save(stream);
+        const auto bytes = stream.str();
+        // the count ends the header, right before the payload
+        const size_t payload = std::is_same_v<T, std::string> ? sizeof(uint64_t) : sizeof(T);
+        for (const uint64_t count: {uint64_t{1} << 60, UINT64_MAX / 2, UINT64_MAX}) {
+            auto copy = bytes;
+            std::memcpy(copy.data() + copy.size() - payload - sizeof(count), &count, sizeof(count));
+            std::stringstream seekable(copy);
+            CHECK_THROWS_AS(MyContainer<T>::load(seekable), std::runtime_error);
+            OneWay buffer(copy);
+            std::istream one_way(&buffer);
+            CHECK_THROWS_AS(MyContainer<T>::load(one_way), std::runtime_error);
+        }
+        OneWay whole(bytes);
+        std::istream one_way(&whole);
+        CHECK(MyContainer<T>::load(one_way).size() == 1);
+    }
+}
+
+TEST_SUITE("Mapped") {
+    TEST_CASE("Mapped orders match an in-memory container") {
+        const auto path = temp_path("containers_mapped_test.bin");
+        MyContainer<int> expected;
+        {
+            MappedContainer<int> m(path);
+            for (const int k: random_keys<int>(20000, 1000, 5)) {
+                m.add(k);
+                expected.add(k);
+            }
+            REQUIRE(m.size() == expected.size());
+            CHECK(walk(m.begin_order()) == walk(expected.begin_order()));
+            CHECK(walk(m.begin_reverse_order()) == walk(expected.begin_reverse_order()));
+            CHECK(walk(m.begin_ascending_order()) == walk(expected.begin_ascending_order()));
+            CHECK(walk(m.begin_descending_order()) == walk(expected.begin_descending_order()));
+            CHECK(walk(m.begin_side_cross_order()) == walk(expected.begin_side_cross_order()));
+            CHECK(walk(m.begin_middle_out_order()) == walk(expected.begin_middle_out_order()));
+            CHECK(m.contains(expected[7]));
+            CHECK(m.count(expected[7]) == expected.count(expected[7]));
+
+            std::vector<int> batched;
+            m.begin_order().for_each_batch(
+                [&](std::span<const int> b) { batched.insert(batched.end(), b.begin(), b.end()); }, 999);
+            CHECK(batched == walk(expected.begin_order()));
+        }
+        // the file keeps exactly the header and the elements, and opens again
+        CHECK(std::filesystem::file_size(path) == sizeof(detail::MappedHeader) + expected.size() * sizeof(int));
+        MappedContainer<int> reopened(path);
+        CHECK(walk(reopened.begin_order()) == walk(expected.begin_order()));
+        std::filesystem::remove(path);
+    }
+
+    // runs fn on the container at path in a child process that then dies without running any destructor
+    void crash_after(const std::string &path, const std::function<void(MappedContainer<int> &)> &fn) {
+        const pid_t child = ::fork();
+        REQUIRE(child >= 0);
+        if (child == 0) {
+            MappedContainer<int> m(path);
+            fn(m);
+            ::_exit(0);
+        }
+        int status = 0;
+        ::waitpid(child, &status, 0);
+        REQUIRE(WIFEXITED(status));
+    }
+
+    // the files a remove wrote next to path and no flush put in its place, removed
+    size_t remove_side_files(const std::string &path) {
+        size_t n = 0;
+        const auto name = std::filesystem::path(path).filename().string() + ".";
+        for (const auto &entry: std::filesystem::directory_iterator(std::filesystem::path(path).parent_path()))
+            if (entry.path().filename().string().rfind(name, 0) == 0) n += std::filesystem::remove(entry.path());
+        return n;
+    }
+
+    TEST_CASE("A flush survives a crash") {
+        const auto path = temp_path("containers_mapped_flush.bin");
+        crash_after(path, [](MappedContainer<int> &m) {
+            m.add(42);
+            m.flush();
+            m.add(7); // after the flush: not saved
+        });
+        {
+            MappedContainer<int> m(path);
+            CHECK(walk(m.begin_order()) == std::vector{42});
+        }
+        CHECK_THROWS_AS(MappedContainer<double>{path}, std::runtime_error);
+        std::filesystem::resize_file(path, 3);
+        CHECK_THROWS_AS(MappedContainer<int>{path}, std::runtime_error);
+        std::filesystem::remove(path);
+    }
+
+    TEST_CASE("Removes take effect at the next flush") {
+        const auto path = temp_path("containers_mapped_remove.bin");
+        crash_after(path, [](MappedContainer<int> &m) {
+            for (const int k: {1, 2, 3, 2}) m.add(k);
+            m.flush();
+            m.remove(2); // reaches saved elements: written aside
+            m.add(5);
+            m.remove(5);
+        });
+        CHECK(walk(MappedContainer<int>(path).begin_order()) == std::vector{1, 2, 3, 2});
+        CHECK(remove_side_files(path) == 1);
+
+        crash_after(path, [](MappedContainer<int> &m) {
+            m.remove(2);
+            m.flush();
+            m.add(6);
+            m.flush();
+            m.add(7);
+            m.add(8);
+            m.remove(7); // only unsaved elements move, in place
+            m.remove(6);
+        });
+        CHECK(walk(MappedContainer<int>(path).begin_order()) == std::vector{1, 3, 6});
+        CHECK(remove_side_files(path) == 1);
+        std::filesystem::remove(path);
+    }
+
+    TEST_CASE("Mapped iterators keep their elements") {
+        const auto path = temp_path("containers_mapped_cow.bin");
+        {
+            MappedContainer<int> m(path);
+            for (const int k: {4, 1, 4, 3}) m.add(k);
+            const auto before = m.begin_order();
+            const auto sorted = m.begin_ascending_order();
+            m.remove(4);
+            m.add(0);
+            CHECK(walk(before) == std::vector{4, 1, 4, 3});
+            CHECK(walk(sorted) == std::vector{1, 3, 4, 4});
+            CHECK(walk(m.begin_order()) == std::vector{1, 3, 0});
+            CHECK(walk(m.begin_ascending_order()) == std::vector{0, 1, 3});
+            CHECK(m.try_remove(9) == 0);
+            CHECK_THROWS_AS(m.remove(9), std::runtime_error);
+            CHECK_THROWS_AS(m[3], std::runtime_error);
+            m.flush();
+            CHECK(walk(before) == std::vector{4, 1, 4, 3});
+        }
+        // the side file took the path
+        CHECK(remove_side_files(path) == 0);
+        CHECK(walk(MappedContainer<int>(path).begin_order()) == std::vector{1, 3, 0});
+        std::filesystem::remove(path);
+    }
+
+    TEST_CASE_TEMPLATE("External sort matches std::sort within any budget", T, int, double, char) {
+        const auto keys = random_keys<T>(30000, 5000, 21);
+        auto expected = keys;
+        std::sort(expected.begin(), expected.end());
+        const auto dir = std::filesystem::temp_directory_path().string();
+        for (const size_t budget: {sizeof(T), size_t{4096}, size_t{64} << 10, size_t{1} << 20}) {
+            std::vector<T> out(keys.size());
+            detail::external_sort(keys.data(), keys.size(), out.data(), budget, Parallelism{}, dir);
+            CHECK(out == expected);
+        }
+    }
+
+    TEST_CASE_TEMPLATE("External sort allocates within the budget", T, int, double, char) {
+        const auto keys = random_keys<T>(100000, 1 << 20, 22);
+        const auto dir = std::filesystem::temp_directory_path().string();
+        std::vector<T> out(keys.size());
+        for (const size_t budget: {size_t{16} << 10, size_t{64} << 10, size_t{1} << 20}) {
+            const AllocationProbe probe;
+            detail::external_sort(keys.data(), keys.size(), out.data(), budget, Parallelism{2, 1}, dir);
+            // a few hundred bytes of bookkeeping (run bounds, readers) come on top of the elements
+            CHECK(AllocationProbe::peak() <= static_cast<long long>(budget + 2048));
+            CHECK(std::is_sorted(out.begin(), out.end()));
+        }
+    }
+
+    TEST_CASE("Mapped sorted orders keep to the memory budget") {
+        const auto path = temp_path("containers_mapped_budget.bin");
+        MyContainer<int> expected;
+        MappedContainer<int> m(path);
+        m.set_memory_budget(4096);
+        for (const int k: random_keys<int>(50000, 100000, 8)) {
+            m.add(k);
+            expected.add(k);
+        }
+        CHECK(walk(m.begin_ascending_order()) == walk(expected.begin_ascending_order()));
+        CHECK(walk(m.begin_descending_order()) == walk(expected.begin_descending_order()));
+        CHECK(walk(m.begin_side_cross_order()) == walk(expected.begin_side_cross_order()));
+        CHECK(walk(m.begin_middle_out_order()) == walk(expected.begin_middle_out_order()));
+        std::filesystem::remove(path);
+    }
+}
+
+TEST_SUITE("Text") {
+    template<typename It>
+    std::string streamed(It it) {
+        std::ostringstream os;
+        for (; it; ++it) os << *it << " ";
+        return os.str();
+    }
+
+    TEST_CASE_TEMPLATE("Fast formatting matches operator<< item by item", T, int, double, char, float) {
+        MyContainer<T> c;
+        for (const T k: random_keys<T>(40000, 100000, 13)) c.add(k / T(3));
+        c.add(std::numeric_limits<T>::max());
+        c.add(std::numeric_limits<T>::lowest());
+        for (const auto threads: {size_t{1}, size_t{4}}) {
+            c.set_parallelism({threads, 1});
+            std::ostringstream all, asc, dsc, sc, mo, rev;
+            all << c;
+            c.write_ascending(asc);
+            c.write_descending(dsc);
+            c.write_side_cross(sc);
+            c.write_middle_out(mo);
+            c.write_reverse_order(rev);
+            CHECK(all.str() == streamed(c.begin_order()));
+            CHECK(rev.str() == streamed(c.begin_reverse_order()));
+            CHECK(asc.str() == streamed(c.begin_ascending_order()));
+            CHECK(dsc.str() == streamed(c.begin_descending_order()));
+            CHECK(sc.str() == streamed(c.begin_side_cross_order()));
+            CHECK(mo.str() == streamed(c.begin_middle_out_order()));
+        }
+    }
+
+    TEST_CASE("Configured streams and descriptors") {
+        MyContainer<double> c;
+        for (const double x: {1.0 / 3, 2.5, -1e-7, 12345678.9}) c.add(x);
+        std::ostringstream fast, slow;
+        fast << std::fixed << std::setprecision(2) << c;
+        for (auto it = c.begin_order(); it; ++it) slow << std::fixed << std::setprecision(2) << *it << " ";
+        CHECK(fast.str() == slow.str());
+
+        MyContainer<std::string> words;
+        for (const char *w: {"b", "a", "c"}) words.add(w);
+        const auto path = temp_path("containers_text_test.txt");
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        REQUIRE(fd >= 0);
+        words.write_descending(fd);
+        c.write_ascending(fd);
+        ::close(fd);
+        std::ifstream in(path);
+        const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        CHECK(text == "c b a -1e-07 0.333333 2.5 1.23457e+07 ");
+        std::filesystem::remove(path);
+    }
+
+    TEST_CASE("Tokens match operator>> at every level") {
+        std::mt19937 gen(3);
+        std::string text;
+        for (int i = 0; i < 5000; ++i) {
+            text += std::string(gen() % 3, " \n\t"[gen() % 3]);
+            text += std::to_string(static_cast<int>(gen() % 2000000) - 1000000);
+            text += gen() % 4 ? " " : "\r\n";
+        }
+        std::vector<int> expected;
+        std::istringstream is(text);
+        for (int x; is >> x;) expected.push_back(x);
+        for (const auto l: {simd::Level::Scalar, simd::Level::AVX2, simd::Level::AVX512}) {
+            simd::set_level(l);
+            // every alignment of the token edges against the 64-byte words
+            for (size_t skip = 0; skip < 70; skip += 7) {
+                MyContainer<int> c;
+                parse_into(c, std::string_view(text).substr(skip));
+                std::vector<int> tail;
+                std::istringstream rest(text.substr(skip));
+                for (int x; rest >> x;) tail.push_back(x);
+                CHECK(*c.elements() == tail);
+            }
+            MyContainer<int> serial, parallel;
+            parallel.set_parallelism({4, 1});
+            parse_into(serial, text);
+            parse_into(parallel, text);
+            CHECK(*serial.elements() == expected);
+            CHECK(*parallel.elements() == expected);
+        }
+        simd::set_level(simd::Level::AVX512);
+    }
+
+    TEST_CASE_TEMPLATE("Formatted text parses back", T, int, double, char, std::string) {
+        MyContainer<T> c;
+        if constexpr (std::is_same_v<T, std::string>) for (const char *w: {"x", "hello", "a1", "+"}) c.add(w);
+        else for (const T k: random_keys<T>(3000, 100, 17)) c.add(k < T(0) || k > T(32) ? k : T(33));
+        std::ostringstream os;
+        os << std::setprecision(17) << c;
+        MyContainer<T> back;
+        parse_into(back, os.str());
+        CHECK(*back.elements() == *c.elements());
+
+        const auto path = temp_path("containers_parse_test.txt");
+        std::ofstream(path) << os.str();
+        CHECK(*MyContainer<T>::load_text(path).elements() == *c.elements());
+        std::filesystem::remove(path);
+    }
+
+    TEST_CASE("Bad tokens are rejected") {
+        MyContainer<int> c;
+        CHECK_THROWS_AS(parse_into(c, "1 2 x3"), std::runtime_error);
+        CHECK_THROWS_AS(parse_into(c, "99999999999"), std::out_of_range);
+        CHECK(c.size() == 0);
+        parse_into(c, "  +7\t-8\n");
+        CHECK(*c.elements() == std::vector{7, -8});
+        const auto missing = temp_path("containers_no_such_file");
+        CHECK_THROWS_AS(MyContainer<double>::load_text(missing), std::runtime_error);
+    }
+
+    TEST_CASE("String views walk like strings") {
+        std::string text;
+        for (const int k: random_keys<int>(5000, 700, 19)) text += "w" + std::to_string(k) + (k % 3 ? " " : "\n");
+        auto buffer = std::make_shared<const std::string>(text);
+        MyContainer<std::string_view> views;
+        parse_into(views, *buffer);
+        views.keep_alive(buffer);
+        MyContainer<std::string> copies;
+        parse_into(copies, text);
+        // no copies: every element points into the buffer
+        for (const auto v: *views.elements())
+            CHECK((v.data() >= buffer->data() && v.data() + v.size() <= buffer->data() + buffer->size()));
+
+        CHECK(walk<std::string>(views.begin_order()) == walk(copies.begin_order()));
+        CHECK(walk<std::string>(views.begin_ascending_order()) == walk(copies.begin_ascending_order()));
+        CHECK(walk<std::string>(views.begin_descending_order()) == walk(copies.begin_descending_order()));
+        CHECK(walk<std::string>(views.begin_side_cross_order()) == walk(copies.begin_side_cross_order()));
+        CHECK(walk<std::string>(views.begin_middle_out_order()) == walk(copies.begin_middle_out_order()));
+        CHECK(views.try_remove("w5") == copies.try_remove("w5"));
+        CHECK(walk<std::string>(views.begin_ascending_order()) == walk(copies.begin_ascending_order()));
+        std::ostringstream a, b;
+        a << views;
+        b << copies;
+        CHECK(a.str() == b.str());
+
+        // iterators and views keep the buffer alive after the container and the caller let go of it
+        auto it = views.begin_ascending_order();
+        auto elements = views.elements();
+        const std::weak_ptr<const std::string> watch = buffer;
+        buffer.reset();
+        views = MyContainer<std::string_view>();
+        CHECK(!watch.expired());
+        CHECK(walk<std::string>(it) == walk(copies.begin_ascending_order()));
+        CHECK((*elements)[0] == (*copies.elements())[0]);
+        it = decltype(it)(views);
+        elements.reset();
+        CHECK(watch.expired());
+    }
+
+    TEST_CASE("String views of a mapped file") {
+        const auto path = (std::filesystem::temp_directory_path() / "containers_views_test.txt").string();
+        std::ofstream(path) << "pear apple\tfig\n apple kiwi";
+        auto views = MyContainer<std::string_view>::load_text(path);
+        std::filesystem::remove(path);
+        const auto sorted = views.begin_ascending_order();
+        views.add("plum");
+        views = MyContainer<std::string_view>();
+        CHECK(walk<std::string>(sorted) == std::vector<std::string>{"apple", "apple", "fig", "kiwi", "pear"});
+    }
+}
+
+TEST_SUITE("Packed") {
+    TEST_CASE("Every width packs and unpacks at every level") {
+        std::mt19937 gen(9);
+        for (unsigned width = 0; width <= 32; ++width) {
+            std::array<int, simd::pack_block> in{}, out{};
+            const int base = static_cast<int>(gen());
+            for (auto &x: in) {
+                const uint32_t offset = width == 32 ? gen() : gen() & ((1u << width) - 1);
+                x = static_cast<int>(static_cast<uint32_t>(base) + offset);
+            }
+            std::vector<uint32_t> words(simd::packed_words(width));
+            simd::pack(in.data(), base, width, words.data());
+            for (const auto l: {simd::Level::Scalar, simd::Level::AVX2}) {
+                simd::set_level(l);
+                simd::unpack(words.data(), width, base, out.data());
+                CHECK(out == in);
+            }
+        }
+        simd::set_level(simd::Level::AVX512);
+    }
+
+    TEST_CASE("A block may span the whole int range") {
+        std::vector<int> values(simd::pack_block * 2, 0);
+        values[3] = INT_MIN;
+        values[100] = INT_MAX;
+        values[200] = INT_MAX;
+        values[201] = INT_MIN;
+        PackedContainer p;
+        p.add_all(values);
+        p.add(-1);
+        values.push_back(-1);
+        CHECK(walk(p.begin_order()) == values);
+        CHECK(p.count(INT_MIN) == 2);
+        CHECK(p[100] == INT_MAX);
+        CHECK(p.try_remove(0) == values.size() - 5);
+        CHECK(walk(p.begin_order()) == std::vector{INT_MIN, INT_MAX, INT_MAX, INT_MIN, -1});
+
+        // elements are copies: reading one block never changes what was read from another
+        auto it = p.begin_order();
+        static_assert(std::is_same_v<decltype(*it), int>);
+    }
+
+    TEST_CASE("Packed orders match an in-memory container") {
+        PackedContainer p;
+        MyContainer<int> expected;
+        const auto keys = random_keys<int>(20000, 50, 4);
+        p.add_all(std::span(keys).subspan(0, 777));
+        for (size_t i = 777; i < keys.size(); ++i) p.add(keys[i]);
+        for (const int k: keys) expected.add(k);
+        p.add(INT_MIN);
+        p.add(INT_MAX);
+        expected.add(INT_MIN);
+        expected.add(INT_MAX);
+
+        REQUIRE(p.size() == expected.size());
+        CHECK(walk(p.begin_order()) == walk(expected.begin_order()));
+        CHECK(walk(p.begin_reverse_order()) == walk(expected.begin_reverse_order()));
+        CHECK(walk(p.begin_ascending_order()) == walk(expected.begin_ascending_order()));
+        CHECK(walk(p.begin_descending_order()) == walk(expected.begin_descending_order()));
+        CHECK(walk(p.begin_side_cross_order()) == walk(expected.begin_side_cross_order()));
+        CHECK(walk(p.begin_middle_out_order()) == walk(expected.begin_middle_out_order()));
+        CHECK(p[12345] == std::as_const(expected)[12345]);
+        CHECK(p.count(7) == expected.count(7));
+
+        std::vector<int> batched;
+        p.begin_order().for_each_batch(
+            [&](std::span<const int> b) { batched.insert(batched.end(), b.begin(), b.end()); });
+        CHECK(batched == walk(expected.begin_order()));
+    }
+
+    TEST_CASE("Packed storage is small and copy-on-write") {
+        PackedContainer p;
+        const auto keys = random_keys<int>(100000, 7, 6);
+        p.add_all(keys);
+        CHECK(p.memory_bytes() * 3 < keys.size() * sizeof(int));
+        p.shrink_to_fit();
+        CHECK(p.memory_bytes() * 6 < keys.size() * sizeof(int));
+
+        const auto before = p.begin_order();
+        MyContainer<int> expected;
+        for (const int k: keys) expected.add(k);
+        CHECK(p.try_remove(3) == expected.try_remove(3));
+        CHECK(p.try_remove(100) == 0);
+        CHECK_THROWS_AS(p.remove(100), std::runtime_error);
+        CHECK(walk(p.begin_order()) == walk(expected.begin_order()));
+        CHECK(walk(before) == keys);
+        CHECK_FALSE(p.contains(3));
+    }
+}
+
+TEST_SUITE("Front coding") {
+    std::vector<std::string> words(const size_t n, const unsigned seed) {
+        std::mt19937 gen(seed);
+        std::vector<std::string> out;
+        for (size_t i = 0; i < n; ++i) {
+            std::string w = "https://example.org/catalog/item/";
+            for (size_t k = gen() % 6; k < 8; ++k) w.push_back(static_cast<char>('a' + gen() % 4));
+            out.push_back(std::move(w));
+        }
+        return out;
+    }
+
+    TEST_CASE("Front-coded walks match the sorted container") {
+        MyContainer<std::string> c;
+        for (auto &w: words(5000, 2)) c.add(w);
+        c.add("");
+        for (const size_t restart: {1, 16, 64}) {
+            const FrontCodedIndex index(c, restart);
+            REQUIRE(index.size() == c.size());
+            CHECK(walk(index.begin_ascending_order()) == walk(c.begin_ascending_order()));
+            CHECK(walk(index.begin_descending_order()) == walk(c.begin_descending_order()));
+            CHECK(walk(index.begin_side_cross_order()) == walk(c.begin_side_cross_order()));
+            CHECK(walk(index.begin_middle_out_order()) == walk(c.begin_middle_out_order()));
+        }
+        const FrontCodedIndex parallel(*c.elements(), 32, {4, 1});
+        CHECK(walk(parallel.begin_ascending_order()) == walk(c.begin_ascending_order()));
+    }
+
+    TEST_CASE("Front-coded search and size") {
+        const auto all = words(20000, 5);
+        const FrontCodedIndex index(all);
+        auto sorted = all;
+        std::sort(sorted.begin(), sorted.end());
+        const std::string keys[] = {sorted[0], sorted[777], sorted.back(), "https://example.org/catalog/item/b", "",
+                                    "zzz"};
+        for (const auto &key: keys) {
+            const auto rank = std::lower_bound(sorted.begin(), sorted.end(), key) - sorted.begin();
+            CHECK(index.lower_bound(key) == static_cast<size_t>(rank));
+            CHECK(index.count(key) == static_cast<size_t>(std::count(sorted.begin(), sorted.end(), key)));
+            CHECK(index.contains(key) == std::binary_search(sorted.begin(), sorted.end(), key));
+        }
+        CHECK(index[1234] == sorted[1234]);
+
+        // a run of equal entries across several blocks
+        std::vector<std::string> runs(100, "same");
+        runs.push_back("a");
+        runs.push_back("z");
+        const FrontCodedIndex repeated(runs, 16);
+        CHECK(repeated.count("same") == 100);
+        CHECK(repeated.count("a") == 1);
+        CHECK(repeated.count("z") == 1);
+        CHECK(repeated.count("b") == 0);
+        CHECK(repeated.count("zz") == 0);
+
+        size_t copy = sorted.capacity() * sizeof(std::string);
+        for (const auto &s: sorted) copy += s.capacity() + 1;
+        CHECK(index.memory_bytes() * 4 < copy);
+    }
+
+    TEST_CASE("String containers may keep their sorted index front-coded") {
+        MyContainer<std::string> c;
+        for (auto &w: words(5000, 3)) c.add(w);
+        MyContainer<std::string> plain = c;
+        c.set_front_coding(16);
+        CHECK(walk(c.begin_ascending_order()) == walk(plain.begin_ascending_order()));
+        CHECK(walk(c.begin_middle_out_order()) == walk(plain.begin_middle_out_order()));
+        std::vector<std::string> generated;
+        for (const auto &s: c.generate_descending_order()) generated.push_back(s);
+        CHECK(generated == walk(plain.begin_descending_order()));
+
+        // the cache keeps the encoding; a decoded view lasts as long as something holds it
+        const auto index = c.front_coded();
+        REQUIRE(index);
+        CHECK(index->count == c.size());
+        {
+            const auto view = c.sorted_elements();
+            CHECK(c.sorted_elements() == view);
+        }
+        const std::weak_ptr<const std::vector<std::string>> dropped = c.sorted_elements();
+        CHECK(dropped.expired());
+        CHECK(c.front_coded() == index);
+        CHECK(walk(FrontCodedIndex(c, 16).begin_side_cross_order()) == walk(plain.begin_side_cross_order()));
+
+        c.add("aaa");
+        CHECK(*c.begin_ascending_order() == "aaa");
+        CHECK(c.front_coded() != index);
+        c.set_front_coding(0);
+        CHECK(c.front_coded() == nullptr);
+        CHECK(walk(c.begin_descending_order()).back() == "aaa");
+    }
+
+    TEST_CASE("Front-coded elements outlive the blocks they came from") {
+        const auto all = words(1000, 7);
+        const FrontCodedIndex index(all, 16);
+        auto sorted = all;
+        std::sort(sorted.begin(), sorted.end());
+        auto it = index.begin_side_cross_order();
+        static_assert(std::is_same_v<decltype(*it), std::string>);
+        const auto first = *it, last = it[1];
+        // a third block refills the slots the first two were decoded into
+        CHECK(it[500] == sorted[250]);
+        CHECK(first == sorted.front());
+        CHECK(last == sorted.back());
+    }
+}
+
+TEST_SUITE("Journal") {
+    struct Paths {
+        std::string snapshot, log;
+
+        explicit Paths(const std::string &name) : snapshot(temp_path(name + ".snap")), log(temp_path(name + ".log")) {}
+
+        ~Paths() {
+            std::filesystem::remove(snapshot);
+            std::filesystem::remove(log);
+        }
+    };
+
+    template<typename T>
+    T value(const int k) {
+        if constexpr (std::is_same_v<T, std::string>) return "key" + std::to_string(k);
+        else return static_cast<T>(k);
+    }
+
+    TEST_CASE_TEMPLATE("Recovery replays the log on the last checkpoint", T, int, double, std::string) {
+        const Paths paths("containers_journal_test");
+        MyContainer<T> expected;
+        {
+            JournaledContainer<T> j(paths.snapshot, paths.log);
+            for (int k = 0; k < 3000; ++k) j.add(value<T>(k % 700));
+            j.remove(value<T>(5));
+            j.add(value<T>(5)); // removes and adds of the same value replay in order
+            CHECK(j.remove_all({value<T>(6), value<T>(7), value<T>(100000)}) == 10);
+            j.commit();
+            j.checkpoint();
+            std::vector<T> more;
+            for (int k = 0; k < 500; ++k) more.push_back(value<T>(k));
+            j.add_all(more);
+            CHECK(j.try_remove(value<T>(8)) == 6);
+            j.commit();
+            j.add(value<T>(123456)); // never committed
+            expected = j.container();
+            expected.remove(value<T>(123456));
+        }
+        JournaledContainer<T> j(paths.snapshot, paths.log);
+        CHECK(*j.container().elements() == *expected.elements());
+
+        // a crash between the snapshot and the new log leaves the log of the epoch before: it is dropped
+        const auto stale = paths.log + ".old";
+        std::filesystem::copy_file(paths.log, stale, std::filesystem::copy_options::overwrite_existing);
+        j.checkpoint(true);
+        std::filesystem::rename(stale, paths.log);
+        JournaledContainer<T> again(paths.snapshot, paths.log);
+        CHECK(*again.container().elements() == *expected.elements());
+        CHECK(again.get_log().bytes() == sizeof(detail::LogHeader));
+    }
+
+    TEST_CASE("Batched replay matches the operations one by one") {
+        const Paths paths("containers_replay_test");
+        std::mt19937 rng(23);
+        MyContainer<int> expected;
+        for (const int round: {0, 1}) {
+            {
+                JournaledContainer<int> j(paths.snapshot, paths.log);
+                REQUIRE(*j.container().elements() == *expected.elements());
+                for (int k = 0; k < 20000; ++k) {
+                    const int x = static_cast<int>(rng() % 300);
+                    if (rng() % 4) {
+                        j.add(x);
+                        expected.add(x);
+                    } else CHECK(j.try_remove(x) == expected.try_remove(x));
+                }
+                j.commit();
+            }
+            JournaledContainer<int> j(paths.snapshot, paths.log);
+            CHECK(*j.container().elements() == *expected.elements());
+            if (round == 0) j.checkpoint(); // the second round replays on top of it
+        }
+    }
+
+    TEST_CASE("A torn group is cut off") {
+        const Paths paths("containers_torn_test");
+        size_t whole;
+        {
+            OpLog<int> log(paths.log);
+            log.add_all(std::vector{1, 2, 3});
+            log.remove(2);
+            log.commit();
+            whole = log.bytes();
+            log.add_all(std::vector(1000, 9));
+            log.commit();
+        }
+        std::filesystem::resize_file(paths.log, std::filesystem::file_size(paths.log) - 7);
+        OpLog<int> log(paths.log);
+        CHECK(log.bytes() == whole);
+        std::vector<std::pair<OpLog<int>::Op, std::vector<int>>> runs;
+        CHECK(log.replay([&](const auto op, std::vector<int> &&values) { runs.emplace_back(op, values); }) == 4);
+        CHECK(runs.size() == 2);
+        CHECK(runs[0].second == std::vector{1, 2, 3});
+        CHECK(runs[1].first == OpLog<int>::Op::Remove);
+
+        log.add(4);
+        log.commit();
+        JournaledContainer<int> j(paths.snapshot, paths.log);
+        CHECK(*j.container().elements() == std::vector{1, 3, 4});
+        CHECK_THROWS_AS(OpLog<double>(paths.log), std::runtime_error);
+    }
+
+    TEST_CASE("Concurrent commits share groups") {
+        const Paths paths("containers_group_test");
+        {
+            OpLog<int> log(paths.log);
+            log.set_group_bytes(256);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; ++t)
+                threads.emplace_back([&log, t] {
+                    for (int k = 0; k < 500; ++k) {
+                        log.add(t * 1000 + k);
+                        if (k % 50 == 0) log.commit();
+                    }
+                    log.commit();
+                });
+            for (auto &thread: threads) thread.join();
+        }
+        JournaledContainer<int> j(paths.snapshot, paths.log);
+        auto elements = *j.container().elements();
+        std::sort(elements.begin(), elements.end());
+        std::vector<int> expected;
+        for (int t = 0; t < 4; ++t)
+            for (int k = 0; k < 500; ++k) expected.push_back(t * 1000 + k);
+        CHECK(elements == expected);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace containers::detail {
+    namespace {
+        [[noreturn]] void fail(const std::string &what) {
+            throw std::runtime_error(what + ": " + std::strerror(errno));
+        }
+    }
+
+    /* File */
+
+    File::File(const std::string &path) : fd(::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) {
+        if (fd < 0) fail("Cannot open " + path);
+    }
+
+    File File::temporary(const std::string &dir) {
+        File file;
+        file.fd = ::open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+        if (file.fd >= 0) return file;
+        // no O_TMPFILE on this file system: a named file, unlinked right away
+        std::string name = dir + "/containers-XXXXXX";
+        file.fd = ::mkostemp(name.data(), O_CLOEXEC);
+        if (file.fd < 0) fail("Cannot create a temporary file in " + dir);
+        ::unlink(name.c_str());
+        return file;
+    }
+
+    File File::unique(const std::string &prefix, std::string &name) {
+        File file;
+        name = prefix + ".XXXXXX";
+        file.fd = ::mkostemp(name.data(), O_CLOEXEC);
+        if (file.fd < 0) fail("Cannot create a file next to " + prefix);
+        return file;
+    }
+
+    File File::read_only(const std::string &path) {
+        File file;
+        file.fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file.fd < 0) fail("Cannot open " + path);
+        return file;
+    }
+
+    File::~File() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    size_t File::size() const {
+        struct stat st{};
+        if (::fstat(fd, &st) != 0) fail("Cannot stat file");
+        return static_cast<size_t>(st.st_size);
+    }
+
+    void File::resize(const size_t bytes) const {
+        if (::ftruncate(fd, static_cast<off_t>(bytes)) != 0) fail("Cannot resize file");
+    }
+
+    void File::read_at(void *buffer, size_t bytes, size_t offset) const {
+        for (auto *p = static_cast<char *>(buffer); bytes;) {
+            const ssize_t n = ::pread(fd, p, bytes, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) fail("Cannot read file");
+            if (n == 0) throw std::runtime_error("Unexpected end of file");
+            p += n;
+            bytes -= n;
+            offset += n;
+        }
+    }
+
+    void File::write_at(const void *buffer, size_t bytes, size_t offset) const {
+        for (auto *p = static_cast<const char *>(buffer); bytes;) {
+            const ssize_t n = ::pwrite(fd, p, bytes, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) fail("Cannot write file");
+            p += n;
+            bytes -= n;
+            offset += n;
+        }
+    }
+
+    void File::sync() const {
+        while (::fsync(fd) != 0)
+            if (errno != EINTR) fail("Cannot sync file");
+    }
+
+    void sync_directory(const std::string &dir) { File::read_only(dir).sync(); }
+
+    /* Mapping */
+
+    Mapping::Mapping(const File &file, const size_t bytes, const bool writable) : bytes(bytes) {
+        void *p = ::mmap(nullptr, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file.get(), 0);
+        if (p == MAP_FAILED) fail("Cannot map file");
+        base = static_cast<char *>(p);
+    }
+
+    Mapping::~Mapping() { ::munmap(base, bytes); }
+
+    void Mapping::advise(const Access access) const {
+        const int advice = access == Access::Sequential ? MADV_SEQUENTIAL
+                           : access == Access::Random   ? MADV_RANDOM
+                                                        : MADV_NORMAL;
+        // only a hint: failure changes nothing
+        ::madvise(base, bytes, advice);
+    }
+
+    void Mapping::sync() const {
+        if (::msync(base, bytes, MS_SYNC) != 0) fail("Cannot write mapping back");
+    }
+
+    size_t page_size() {
+        static const size_t size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        return size;
+    }
+} // namespace containers::detail
@@ -0,0 +1,88 @@
+#ifndef FILE_HPP
+#define FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+namespace containers::detail {
+    /* Files and mappings (POSIX) */
+
+    // owned file descriptor
+    class File {
+        int fd = -1;
+
+    public:
+        File() = default;
+
+        // opens path for reading and writing, creating it if needed
+        explicit File(const std::string &path);
+
+        // opens an existing file for reading only
+        static File read_only(const std::string &path);
+
+        // unnamed file in dir, gone once closed
+        static File temporary(const std::string &dir);
+
+        // new file named prefix followed by a unique suffix, its name stored in name (as mkstemp does)
+        static File unique(const std::string &prefix, std::string &name);
+
+        File(File &&other) noexcept : fd(std::exchange(other.fd, -1)) {}
+
+        File &operator=(File &&other) noexcept {
+            std::swap(fd, other.fd);
+            return *this;
+        }
+
+        ~File();
+
+        int get() const { return fd; }
+
+        size_t size() const;
+
+        void resize(size_t bytes) const;
+
+        // whole-buffer positional I/O; reads past the end of the file throw
+        void read_at(void *buffer, size_t bytes, size_t offset) const;
+
+        void write_at(const void *buffer, size_t bytes, size_t offset) const;
+
+        // waits until what was written is on the device (for a directory: the entries renamed into it)
+        void sync() const;
+    };
+
+    // waits until the entries renamed into dir are on the device
+    void sync_directory(const std::string &dir);
+
+    // how a mapping is about to be read, passed on to madvise
+    enum class Access { Normal, Sequential, Random };
+
+    // shared mapping of the first bytes of a file (writable unless asked otherwise); stays valid after the
+    // file is closed
+    class Mapping {
+        char *base = nullptr;
+        size_t bytes = 0;
+
+    public:
+        Mapping(const File &file, size_t bytes, bool writable = true);
+
+        Mapping(const Mapping &) = delete;
+
+        Mapping &operator=(const Mapping &) = delete;
+
+        ~Mapping();
+
+        char *data() const { return base; }
+
+        size_t size() const { return bytes; }
+
+        void advise(Access access) const;
+
+        // writes dirty pages back to the file
+        void sync() const;
+    };
+
+    size_t page_size();
+} // namespace containers::detail
+
+#endif //FILE_HPP
@@ -0,0 +1,177 @@
+#ifndef FRONTCODED_HPP
+#define FRONTCODED_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "containers.hpp"
+
+namespace containers {
+    /* Front-coded sorted index */
+
+    // Sorted strings stored front-coded (see detail::FrontCoded): every entry is the length of the prefix it
+    // shares with the entry before it, then the rest of it, and every restart-th entry is stored whole, so that
+    // any entry decodes from the restart before it. Sorted sets of related strings shrink several times against
+    // a sorted std::vector<std::string>. Walks decode a block between restarts at a time; searches binary search
+    // the restarts and decode one block. Copies share the encoding, which never changes, and so does a string
+    // MyContainer that keeps its sorted index front-coded (set_front_coding).
+    class FrontCodedIndex {
+        using Encoding = detail::FrontCoded;
+
+        std::shared_ptr<const Encoding> data = std::make_shared<Encoding>();
+
+    public:
+        FrontCodedIndex() = default;
+
+        // Sorts the elements (views of them, so the strings are not copied) and encodes them with a restart
+        // every `restart` entries; 16 to 64 trade size against the length of a block to decode.
+        explicit FrontCodedIndex(const std::vector<std::string> &elements, const size_t restart = 32,
+                                 const Parallelism &p = {}) {
+            std::vector<std::string_view> sorted(elements.begin(), elements.end());
+            const auto sort_run = [](std::string_view *first, const size_t n) { std::sort(first, first + n); };
+            if (p.applies(sorted.size())) parallel_sort(sorted.data(), sorted.size(), p.threads, sort_run);
+            else sort_run(sorted.data(), sorted.size());
+            data = detail::front_code(sorted, restart);
+        }
+
+        // shares the container's own index when it keeps one front-coded at this interval
+        explicit FrontCodedIndex(const MyContainer<std::string> &c, const size_t restart = 32) {
+            if (c.get_front_coding() == restart) data = c.front_coded();
+            else *this = FrontCodedIndex(*c.elements(), restart, c.get_parallelism());
+        }
+
+        size_t size() const { return data->count; }
+
+        size_t restart_interval() const { return data->interval; }
+
+        // bytes held by the encoding
+        size_t memory_bytes() const {
+            return data->bytes.capacity() + data->restarts.capacity() * sizeof(uint64_t);
+        }
+
+        std::string operator[](const size_t index) const {
+            if (index >= size()) throw std::runtime_error("Index out of range");
+            std::string found;
+            size_t i = index / data->interval * data->interval;
+            data->for_each_in_block(index / data->interval, [&](const std::string_view s) {
+                if (i++ == index) found = s;
+            });
+            return found;
+        }
+
+        /* Search */
+
+        // rank of the first entry not less than key
+        size_t lower_bound(const std::string_view key) const {
+            const auto &e = *data;
+            // first block whose restart entry is not below key; the rank lies in the block before it
+            size_t lo = 0, hi = e.restarts.size();
+            while (lo < hi) {
+                const size_t mid = (lo + hi) / 2;
+                if (e.restart_entry(mid) < key) lo = mid + 1;
+                else hi = mid;
+            }
+            if (lo == 0) return 0;
+            size_t rank = (lo - 1) * e.interval;
+            bool done = false;
+            e.for_each_in_block(lo - 1, [&](const std::string_view s) {
+                if (!done && s < key) ++rank;
+                else done = true;
+            });
+            return rank;
+        }
+
+        bool contains(const std::string_view key) const {
+            const size_t rank = lower_bound(key);
+            return rank < size() && (*this)[rank] == key;
+        }
+
+        // decodes the blocks from the first match on in order, up to the first entry past the matches
+        size_t count(const std::string_view key) const {
+            const auto &e = *data;
+            const size_t first = lower_bound(key);
+            size_t n = 0, at = first / e.interval * e.interval;
+            bool done = false;
+            for (size_t block = first / e.interval; !done && block < e.restarts.size(); ++block)
+                e.for_each_in_block(block, [&](const std::string_view s) {
+                    if (done || at++ < first) return;
+                    if (s == key) ++n;
+                    else done = true;
+                });
+            return n;
+        }
+
+        /* Iterators */
+
+        // Walks the index in one of the sorted orders. The last two blocks it decoded are kept (the two-ended
+        // walks read from two places at once), so a walk decodes every block about once. Elements are returned
+        // by value: the slots are refilled as the walk moves on, so a reference into them would not last.
+        class Iterator : public WalkIterator<Iterator, std::string> {
+            friend class WalkIterator<Iterator, std::string>;
+
+        protected:
+            struct Slot {
+                size_t block = SIZE_MAX;
+                std::vector<std::string> entries;
+            };
+
+            std::shared_ptr<const Encoding> data;
+            mutable std::array<Slot, 2> slots;
+            mutable size_t last = 0; // slot used last
+
+            // the decoded entry; valid until the next call
+            const std::string &element(const size_t at) const {
+                const size_t block = at / data->interval;
+                size_t s = slots[0].block == block ? 0 : slots[1].block == block ? 1 : SIZE_MAX;
+                if (s == SIZE_MAX) {
+                    s = 1 - last;
+                    auto &slot = slots[s];
+                    slot.block = block;
+                    size_t k = 0;
+                    data->for_each_in_block(block, [&](const std::string_view e) {
+                        if (k == slot.entries.size()) slot.entries.emplace_back();
+                        slot.entries[k++].assign(e);
+                    });
+                }
+                last = s;
+                return slots[s].entries[at % data->interval];
+            }
+
+        public:
+            Iterator(const FrontCodedIndex &index, const Walk walk) : WalkIterator(walk), data(index.data) {}
+
+            size_t size() const { return data->count; }
+
+            bool operator==(const Iterator &other) const {
+                if (pos != other.pos || walk != other.walk || size() != other.size()) return false;
+                return data == other.data || (data->interval == other.data->interval &&
+                                              data->bytes == other.data->bytes);
+            }
+        };
+
+        using AscendingOrder = WalkOrder<Iterator, Walk::Forward>;
+        using DescendingOrder = WalkOrder<Iterator, Walk::Backward>;
+        using SideCrossOrder = WalkOrder<Iterator, Walk::SideCross>;
+        using MiddleOutOrder = WalkOrder<Iterator, Walk::MiddleOut>;
+
+        AscendingOrder begin_ascending_order() const { return at_begin(AscendingOrder(*this)); }
+        AscendingOrder end_ascending_order() const { return at_end(AscendingOrder(*this)); }
+
+        DescendingOrder begin_descending_order() const { return at_begin(DescendingOrder(*this)); }
+        DescendingOrder end_descending_order() const { return at_end(DescendingOrder(*this)); }
+
+        SideCrossOrder begin_side_cross_order() const { return at_begin(SideCrossOrder(*this)); }
+        SideCrossOrder end_side_cross_order() const { return at_end(SideCrossOrder(*this)); }
+
+        MiddleOutOrder begin_middle_out_order() const { return at_begin(MiddleOutOrder(*this)); }
+        MiddleOutOrder end_middle_out_order() const { return at_end(MiddleOutOrder(*this)); }
+    };
+} // namespace containers
+
+#endif //FRONTCODED_HPP
@@ -0,0 +1,95 @@
+#ifndef GENERATOR_HPP
+#define GENERATOR_HPP
+
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+namespace containers {
+    /* Generator */
+
+    // Lazy sequence of const T& produced by a coroutine, consumed once with range-for (a local stand-in for
+    // C++23 std::generator). Yielded references stay valid until the consumer advances.
+    template<typename T>
+    class Generator {
+    public:
+        struct promise_type {
+            const T *current = nullptr;
+            std::exception_ptr error;
+
+            Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+
+            std::suspend_always yield_value(const T &value) noexcept {
+                current = std::addressof(value);
+                return {};
+            }
+
+            void return_void() {}
+
+            void unhandled_exception() { error = std::current_exception(); }
+
+            // generators only yield
+            template<typename U>
+            std::suspend_never await_transform(U &&) = delete;
+        };
+
+        class iterator {
+            friend class Generator;
+
+            std::coroutine_handle<promise_type> coroutine;
+
+            explicit iterator(const std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+
+        public:
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+
+            const T &operator*() const { return *coroutine.promise().current; }
+
+            iterator &operator++() {
+                resume(coroutine);
+                return *this;
+            }
+
+            void operator++(int) { ++*this; }
+
+            bool operator==(std::default_sentinel_t) const { return coroutine.done(); }
+        };
+
+        Generator(Generator &&other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+
+        Generator &operator=(Generator &&other) noexcept {
+            std::swap(coroutine, other.coroutine);
+            return *this;
+        }
+
+        ~Generator() {
+            if (coroutine) coroutine.destroy();
+        }
+
+        // runs up to the first element; call once
+        iterator begin() {
+            resume(coroutine);
+            return iterator(coroutine);
+        }
+
+        std::default_sentinel_t end() const { return {}; }
+
+    private:
+        std::coroutine_handle<promise_type> coroutine;
+
+        explicit Generator(const std::coroutine_handle<promise_type> coroutine) : coroutine(coroutine) {}
+
+        static void resume(const std::coroutine_handle<promise_type> coroutine) {
+            coroutine.resume();
+            if (auto &error = coroutine.promise().error) std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    };
+} // namespace containers
+
+#endif //GENERATOR_HPP
@@ -0,0 +1,484 @@
+#ifndef MAPPED_HPP
+#define MAPPED_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "containers.hpp"
+#include "file.hpp"
+
+namespace containers {
+    namespace detail {
+        /* External sort */
+
+        // streams elements [first, last) of a file through a buffer
+        template<typename T>
+        class RunReader {
+            const File *file;
+            size_t next, last;
+            std::vector<T> buffer;
+            size_t at = 0;
+
+        public:
+            RunReader(const File &file, const size_t first, const size_t last, const size_t buffer)
+                : file(&file), next(first), last(last) { this->buffer.reserve(buffer); }
+
+            // loads the next block if the buffer is used up, false once the run is
+            bool fill() {
+                if (at < buffer.size()) return true;
+                if (next == last) return false;
+                buffer.resize(std::min(buffer.capacity(), last - next));
+                file->read_at(buffer.data(), buffer.size() * sizeof(T), next * sizeof(T));
+                next += buffer.size();
+                at = 0;
+                return true;
+            }
+
+            const T &front() const { return buffer[at]; }
+
+            void pop() { ++at; }
+        };
+
+        // appends elements to a file from a given element position on, one buffer at a time
+        template<typename T>
+        class RunWriter {
+            const File *file;
+            size_t next;
+            std::vector<T> buffer;
+
+        public:
+            RunWriter(const File &file, const size_t first, const size_t buffer) : file(&file), next(first) {
+                this->buffer.reserve(buffer);
+            }
+
+            void operator()(const T &value) {
+                buffer.push_back(value);
+                if (buffer.size() == buffer.capacity()) flush();
+            }
+
+            void flush() {
+                file->write_at(buffer.data(), buffer.size() * sizeof(T), next * sizeof(T));
+                next += buffer.size();
+                buffer.clear();
+            }
+        };
+
+        // k-way merge of sorted runs into out(const T &), smallest first; ties go to the earlier run
+        template<typename T, typename Out>
+        void merge_runs(std::vector<RunReader<T>> &runs, Out &&out) {
+            std::vector<size_t> heap;
+            for (size_t r = 0; r < runs.size(); ++r)
+                if (runs[r].fill()) heap.push_back(r);
+            const auto later = [&](const size_t a, const size_t b) {
+                const T &x = runs[a].front(), &y = runs[b].front();
+                return y < x || (!(x < y) && b < a);
+            };
+            std::make_heap(heap.begin(), heap.end(), later);
+            while (!heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                auto &run = runs[heap.back()];
+                out(run.front());
+                run.pop();
+                if (run.fill()) std::push_heap(heap.begin(), heap.end(), later);
+                else heap.pop_back();
+            }
+        }
+
+        // Elements per run of an external sort that holds at most `budget` bytes of elements at once. The
+        // vectorized sort stages a run's elements in scratch as large as the run (plus 64 slots per thread),
+        // and the parallel sort merges through a buffer that large, so those runs get half the budget; std::sort
+        // works in place.
+        template<typename T>
+        size_t external_run(const size_t budget, const Parallelism &p) {
+            constexpr bool simd_sorted =
+                    std::is_same_v<T, int> || std::is_same_v<T, float> || std::is_same_v<T, double>;
+            const size_t elements = budget / sizeof(T);
+            if (!simd_sorted && p.threads <= 1) return std::max<size_t>(elements, 1);
+            const size_t slack = simd_sorted ? 64 * std::max<size_t>(p.threads, 1) : 0;
+            return std::max<size_t>(elements > slack ? (elements - slack) / 2 : 0, 1);
+        }
+
+        // Sorts in[0, n) into out[0, n) holding at most about `budget` bytes of elements in memory, sort
+        // scratch included: runs of external_run() elements are sorted and spilled to unnamed files in dir,
+        // then merged with a fan-in that gives each run a buffer of at least a page (more passes if there are
+        // more runs than that). in and out are usually mappings, so both are read and written front to back only.
+        template<typename T>
+        void external_sort(const T *in, const size_t n, T *out, const size_t budget, const Parallelism &p,
+                           const std::string &dir) {
+            const auto sort = [&](T *first, const size_t k) {
+                if (p.applies(k)) parallel_sort(first, k, p.threads, sort_run<T>);
+                else sort_run(first, k);
+            };
+            const size_t run = external_run<T>(budget, p);
+            if (n <= run) {
+                std::copy(in, in + n, out);
+                sort(out, n);
+                return;
+            }
+
+            File runs = File::temporary(dir);
+            std::vector<size_t> bounds{0};
+            {
+                std::vector<T> buffer;
+                buffer.reserve(run);
+                for (size_t first = 0; first < n; first += run) {
+                    buffer.assign(in + first, in + std::min(n, first + run));
+                    sort(buffer.data(), buffer.size());
+                    runs.write_at(buffer.data(), buffer.size() * sizeof(T), first * sizeof(T));
+                    bounds.push_back(first + buffer.size());
+                }
+            }
+
+            const size_t block = std::max<size_t>(page_size() / sizeof(T), 1);
+            const size_t fan_in = std::max<size_t>(run / block, 3) - 1;
+            const size_t buffer = std::max<size_t>(run / (fan_in + 1), 1);
+            const auto readers = [&](const size_t b, const size_t e) {
+                std::vector<RunReader<T>> r;
+                for (size_t i = b; i < e; ++i) r.emplace_back(runs, bounds[i], bounds[i + 1], buffer);
+                return r;
+            };
+            while (bounds.size() - 1 > fan_in) {
+                File next = File::temporary(dir);
+                std::vector<size_t> merged{0};
+                for (size_t b = 0; b + 1 < bounds.size(); b += fan_in) {
+                    const size_t e = std::min(b + fan_in, bounds.size() - 1);
+                    auto group = readers(b, e);
+                    RunWriter<T> writer(next, bounds[b], buffer);
+                    merge_runs(group, writer);
+                    writer.flush();
+                    merged.push_back(bounds[e]);
+                }
+                runs = std::move(next);
+                bounds = std::move(merged);
+            }
+            auto all = readers(0, bounds.size() - 1);
+            merge_runs(all, [&out](const T &value) { *out++ = value; });
+        }
+
+        // First bytes of a MappedContainer file; the elements follow. count is only written by flush() (and
+        // the destructor), after the elements it covers, so a reopened file holds what the last flush saved.
+        struct MappedHeader {
+            static constexpr uint32_t magic_number = 0x50414d43; // "CMAP"
+            static constexpr uint32_t current_version = 1;
+
+            uint32_t magic = magic_number;
+            uint32_t version = current_version;
+            uint32_t type = 0; // type_code<T>()
+            uint32_t element_size = 0;
+            uint64_t count = 0;
+            char reserved[40] = {}; // keeps the elements 64-byte aligned
+        };
+
+        static_assert(sizeof(MappedHeader) == 64);
+    } // namespace detail
+
+    /* Memory-mapped container */
+
+    // Container of trivially copyable elements kept in a file mapped into memory, so it may hold more than
+    // fits in RAM: pages are read on demand and written back by the kernel. The file holds a header with the
+    // element count (see detail::MappedHeader), then the elements back to back in native byte order; appends
+    // grow it geometrically and the destructor trims it to the elements. flush() is the durability point:
+    // nothing a flush saved changes on disk before the next one, so a crash in between reopens the elements of
+    // the last flush. Appends go to the slack past the saved count. A remove that only moves unsaved elements
+    // compacts them in place; one that reaches saved elements, or runs while iterators are alive, writes the
+    // remaining elements to a side file next to the data instead, which takes the file's path at the next
+    // flush. Iterators keep the mapping they were built from, so later modifications never reach them.
+    // Sorted orders walk a sorted copy in an unnamed temporary file next to the data, written by an external
+    // merge sort that keeps to the memory budget.
+    template<typename T>
+    class MappedContainer {
+        static_assert(std::is_trivially_copyable_v<T>, "MappedContainer needs trivially copyable elements");
+
+        using Mapping = detail::Mapping;
+        using Header = detail::MappedHeader;
+
+        std::string path;
+        detail::File file;
+        std::shared_ptr<const Mapping> mapping; // the header and at least the elements
+        size_t length = 0;
+        size_t saved = 0; // the leading elements the file at path holds as of the last flush
+        std::string side; // the file being written instead of path until the next flush, if any
+        Parallelism parallelism;
+        size_t budget = size_t{256} << 20;
+        size_t generation = 0;
+
+        struct Cache {
+            size_t generation = 0;
+            std::shared_ptr<const Mapping> sorted;
+        };
+
+        mutable Cache cache;
+
+        T *elements() const { return reinterpret_cast<T *>(mapping->data() + sizeof(Header)); }
+
+        size_t capacity() const { return (mapping->size() - sizeof(Header)) / sizeof(T); }
+
+        // maps the whole file, header and n elements rounded up to whole pages
+        void remap(const size_t n) {
+            const size_t page = detail::page_size();
+            const size_t bytes = (sizeof(Header) + n * sizeof(T) + page - 1) / page * page;
+            if (file.size() < bytes) file.resize(bytes);
+            mapping = std::make_shared<const Mapping>(file, bytes);
+        }
+
+        static Header header_for(const size_t count) {
+            Header header;
+            header.type = detail::type_code<T>();
+            header.element_size = sizeof(T);
+            header.count = count;
+            return header;
+        }
+
+        // writes a new data file in one go: header, then the elements of [first, last) other than skip
+        static void write_file(const detail::File &out, const size_t count, const T *first, const T *last,
+                               const T &skip) {
+            const auto header = header_for(count);
+            out.resize(sizeof(Header) + count * sizeof(T));
+            out.write_at(&header, sizeof(header), 0);
+            if (count) {
+                const detail::Mapping target(out, sizeof(Header) + count * sizeof(T));
+                std::remove_copy(first, last, reinterpret_cast<T *>(target.data() + sizeof(Header)), skip);
+            }
+        }
+
+        std::string directory() const {
+            const auto slash = path.find_last_of('/');
+            return slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+        }
+
+        std::shared_ptr<const Mapping> sorted_mapping() const {
+            if (cache.generation != generation || !cache.sorted) {
+                cache = {generation, nullptr};
+                if (length) {
+                    const auto scratch = detail::File::temporary(directory());
+                    scratch.resize(length * sizeof(T));
+                    auto sorted = std::make_shared<const Mapping>(scratch, length * sizeof(T));
+                    mapping->advise(detail::Access::Sequential);
+                    // a copy that fits the budget is sorted in place; bigger ones only ever stream
+                    sorted->advise(length * sizeof(T) <= budget ? detail::Access::Random : detail::Access::Sequential);
+                    detail::external_sort(elements(), length, reinterpret_cast<T *>(sorted->data()), budget,
+                                          parallelism, directory());
+                    cache.sorted = std::move(sorted);
+                }
+            }
+            return cache.sorted;
+        }
+
+    public:
+        // opens the container stored in path, creating an empty one if there is no such file; throws if the file
+        // holds something else
+        explicit MappedContainer(std::string path) : path(std::move(path)), file(this->path) {
+            Header header;
+            if (file.size() == 0) {
+                header = header_for(0);
+                file.write_at(&header, sizeof(header), 0);
+            } else {
+                if (file.size() < sizeof(header)) throw std::runtime_error("Not a mapped container: " + this->path);
+                file.read_at(&header, sizeof(header), 0);
+                if (header.magic != Header::magic_number)
+                    throw std::runtime_error("Not a mapped container: " + this->path);
+                if (header.version != Header::current_version)
+                    throw std::runtime_error("Unsupported mapped container version " + std::to_string(header.version));
+                if (header.type != detail::type_code<T>() || header.element_size != sizeof(T))
+                    throw std::runtime_error("Mapped container holds another element type");
+                if (file.size() < sizeof(header) + header.count * sizeof(T))
+                    throw std::runtime_error("Truncated mapped container: " + this->path);
+            }
+            length = saved = header.count;
+            remap(length);
+        }
+
+        MappedContainer(const MappedContainer &) = delete;
+
+        MappedContainer &operator=(const MappedContainer &) = delete;
+
+        ~MappedContainer() {
+            try {
+                flush();
+                file.resize(sizeof(Header) + length * sizeof(T));
+            } catch (...) {}
+        }
+
+        const std::string &file_path() const { return path; }
+
+        /* Element Modify methods */
+
+        void add(const T &value) {
+            if (length == capacity()) remap(std::max<size_t>(2 * length, detail::page_size() / sizeof(T)));
+            elements()[length++] = value;
+            ++generation;
+        }
+
+        void remove(const T &value) {
+            if (!try_remove(value)) throw std::runtime_error("Value not found in container");
+        }
+
+        // removes every occurrence of value, returns how many there were
+        size_t try_remove(const T &value) {
+            T *first = elements();
+            const size_t at = std::find(first, first + length, value) - first;
+            if (at == length) return 0;
+            const size_t removed = std::count(first + at, first + length, value);
+            if (mapping.use_count() > 1 || at < saved) {
+                // iterators still read this mapping, or saved elements would move: the rest goes to a side
+                // file, which the next flush puts in place of the old one
+                std::string next;
+                auto out = detail::File::unique(path, next);
+                try {
+                    mapping->advise(detail::Access::Sequential);
+                    write_file(out, length - removed, first, first + length, value);
+                } catch (...) {
+                    std::remove(next.c_str());
+                    throw;
+                }
+                if (!side.empty()) std::remove(side.c_str());
+                side = std::move(next);
+                file = std::move(out);
+                saved = 0;
+                length -= removed;
+                remap(length);
+            } else {
+                // only elements past the last flush move
+                if constexpr (detail::simd_searchable<T>) length = at + simd::remove(first + at, length - at, value);
+                else length = std::remove(first + at, first + length, value) - first;
+            }
+            ++generation;
+            return removed;
+        }
+
+        size_t size() const { return length; }
+
+        /* Search */
+
+        bool contains(const T &value) const {
+            if (!length) return false;
+            mapping->advise(detail::Access::Sequential);
+            if constexpr (detail::simd_searchable<T>) return simd::find(elements(), length, value) < length;
+            else return std::find(elements(), elements() + length, value) != elements() + length;
+        }
+
+        size_t count(const T &value) const {
+            if (!length) return 0;
+            mapping->advise(detail::Access::Sequential);
+            if constexpr (detail::simd_searchable<T>) return simd::count(elements(), length, value);
+            else return std::count(elements(), elements() + length, value);
+        }
+
+        /* Parallelism (used by the sorts) */
+
+        const Parallelism &get_parallelism() const { return parallelism; }
+
+        void set_parallelism(const Parallelism &p) { parallelism = p; }
+
+        /* Memory budget (bytes of elements the sorts hold in memory at once) */
+
+        size_t get_memory_budget() const { return budget; }
+
+        // bigger containers are sorted externally, in budget-sized runs merged from temporary files
+        void set_memory_budget(const size_t bytes) {
+            budget = std::max<size_t>(bytes, sizeof(T));
+        }
+
+        // Writes the elements back to the file, then the count, and waits for the device; a side file left by a
+        // remove then takes the path. A reopened file holds exactly the elements of the last flush.
+        void flush() {
+            mapping->sync();
+            const auto header = header_for(length);
+            file.write_at(&header, sizeof(header), 0);
+            file.sync();
+            if (!side.empty()) {
+                if (std::rename(side.c_str(), path.c_str()) != 0) throw std::runtime_error("Cannot replace " + path);
+                side.clear();
+                detail::sync_directory(directory());
+            }
+            saved = length;
+        }
+
+        const T &operator[](const size_t index) const {
+            if (index >= length) throw std::runtime_error("Index out of range");
+            return elements()[index];
+        }
+
+        friend std::ostream &operator<<(std::ostream &os, const MappedContainer &c) {
+            for (size_t i = 0; i < c.length; ++i) os << c.elements()[i] << " ";
+            return os;
+        }
+
+        /* Iterators */
+
+        class Iterator : public WalkIterator<Iterator, const T &> {
+            friend class WalkIterator<Iterator, const T &>;
+
+        protected:
+            std::shared_ptr<const Mapping> mapping;
+            const T *first = nullptr; // the elements, `offset` bytes into the mapping
+            size_t count = 0;
+
+            Iterator(std::shared_ptr<const Mapping> elements, const size_t offset, const size_t count, const Walk walk)
+                : WalkIterator<Iterator, const T &>(walk), mapping(std::move(elements)), count(count) {
+                if (mapping) first = reinterpret_cast<const T *>(mapping->data() + offset);
+                // a walk from one end streams through the pages; the two-ended walks read from two places
+                if (mapping)
+                    mapping->advise(walk == Walk::Forward || walk == Walk::Backward
+                                        ? detail::Access::Sequential
+                                        : detail::Access::Normal);
+            }
+
+            const T &element(const size_t at) const { return first[at]; }
+
+            // forward walks hand out pieces of the mapping itself
+            std::span<const T> run(const size_t at) const { return {first + at, count - at}; }
+
+        public:
+            Iterator(const MappedContainer &c, const Walk walk) : Iterator(c.mapping, sizeof(Header), c.length, walk) {}
+
+            size_t size() const { return count; }
+
+            bool operator==(const Iterator &other) const {
+                if (this->pos != other.pos || this->walk != other.walk || count != other.count) return false;
+                return mapping == other.mapping || !count || std::equal(first, first + count, other.first);
+            }
+        };
+
+        // walks the sorted copy instead of the file
+        class SortedIterator : public Iterator {
+        public:
+            SortedIterator(const MappedContainer &c, const Walk walk)
+                : Iterator(c.sorted_mapping(), 0, c.length, walk) {}
+        };
+
+        using Order = WalkOrder<Iterator, Walk::Forward>;
+        using ReverseOrder = WalkOrder<Iterator, Walk::Backward>;
+        using AscendingOrder = WalkOrder<SortedIterator, Walk::Forward>;
+        using DescendingOrder = WalkOrder<SortedIterator, Walk::Backward>;
+        using SideCrossOrder = WalkOrder<SortedIterator, Walk::SideCross>;
+        using MiddleOutOrder = WalkOrder<SortedIterator, Walk::MiddleOut>;
+
+        Order begin_order() const { return at_begin(Order(*this)); }
+        Order end_order() const { return at_end(Order(*this)); }
+
+        ReverseOrder begin_reverse_order() const { return at_begin(ReverseOrder(*this)); }
+        ReverseOrder end_reverse_order() const { return at_end(ReverseOrder(*this)); }
+
+        AscendingOrder begin_ascending_order() const { return at_begin(AscendingOrder(*this)); }
+        AscendingOrder end_ascending_order() const { return at_end(AscendingOrder(*this)); }
+
+        DescendingOrder begin_descending_order() const { return at_begin(DescendingOrder(*this)); }
+        DescendingOrder end_descending_order() const { return at_end(DescendingOrder(*this)); }
+
+        SideCrossOrder begin_side_cross_order() const { return at_begin(SideCrossOrder(*this)); }
+        SideCrossOrder end_side_cross_order() const { return at_end(SideCrossOrder(*this)); }
+
+        MiddleOutOrder begin_middle_out_order() const { return at_begin(MiddleOutOrder(*this)); }
+        MiddleOutOrder end_middle_out_order() const { return at_end(MiddleOutOrder(*this)); }
+    };
+} // namespace containers
+
+#endif //MAPPED_HPP
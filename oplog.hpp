@@ -0,0 +1,412 @@
+#ifndef OPLOG_HPP
+#define OPLOG_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "containers.hpp"
+#include "file.hpp"
+#include "varint.hpp"
+
+namespace containers {
+    /* Operation log */
+
+    namespace detail {
+        // Layout of an operation log: this header, then groups of records as they were committed. A group is its
+        // byte count and the fingerprint_bytes() of those bytes (both 64-bit) followed by the records; a record
+        // is an operation byte, a varint count and that many values (raw bytes for trivially copyable types, a
+        // varint length and the bytes for strings). The epoch ties the log to the checkpoint it follows.
+        struct LogHeader {
+            static constexpr uint32_t magic_number = 0x474f4c43; // "CLOG"
+            static constexpr uint32_t current_version = 1;
+
+            uint32_t magic = magic_number;
+            uint32_t version = current_version;
+            uint32_t type = 0; // type_code<T>()
+            uint32_t element_size = 0;
+            uint64_t epoch = 0;
+        };
+
+        struct GroupHeader {
+            uint64_t bytes = 0;
+            uint64_t checksum = 0;
+        };
+    } // namespace detail
+
+    // Write-ahead log of the adds and removes of a container. Operations are encoded into a buffer and reach
+    // the file in groups: commit() writes whatever is buffered as one group and waits for it to be on the
+    // device. Threads committing at the same time share the write and the sync (group commit): one of them
+    // writes every record buffered so far while the others wait for it. A buffer growing past the group size
+    // is written without waiting for the device.
+    //
+    // Opening a log keeps the groups that made it to the file whole: a group cut short by a crash fails its
+    // checksum and is cut off. replay() reads the operations back as runs of the same kind, to be applied in
+    // bulk (add_all, remove_all).
+    template<detail::serializable T>
+    class OpLog {
+    public:
+        enum class Op : uint8_t { Add = 1, Remove = 2 };
+
+    private:
+        std::string path;
+        detail::File file;
+        uint64_t current_epoch = 0;
+        size_t end = 0; // bytes in the file, header included
+
+        mutable std::mutex lock;
+        std::condition_variable done; // an I/O round finished
+        std::string pending; // records not written yet
+        size_t group_bytes = 1 << 20;
+        uint64_t appended = 0, written = 0, durable = 0; // operations buffered / in the file / on the device
+        bool busy = false; // a thread is writing
+
+        static void encode(std::string &out, const T &value) {
+            if constexpr (std::is_same_v<T, std::string>) {
+                detail::put_varint(out, value.size());
+                out.append(value);
+            } else out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+
+        static T decode(const char *&p, const char *last) {
+            if constexpr (std::is_same_v<T, std::string>) {
+                const uint64_t n = detail::get_varint(p, last);
+                if (n > static_cast<uint64_t>(last - p)) throw std::runtime_error("Corrupt log record");
+                std::string value(p, n);
+                p += n;
+                return value;
+            } else {
+                if (static_cast<size_t>(last - p) < sizeof(T)) throw std::runtime_error("Corrupt log record");
+                T value;
+                std::memcpy(&value, p, sizeof(T));
+                p += sizeof(T);
+                return value;
+            }
+        }
+
+        static detail::LogHeader header_for(const uint64_t epoch) {
+            detail::LogHeader header;
+            header.type = detail::type_code<T>();
+            header.element_size = sizeof(T);
+            header.epoch = epoch;
+            return header;
+        }
+
+        // Calls fn(body, bytes) on every whole group in order and returns where the last one ends. The file is
+        // mapped, so fn may only look at the body while it runs.
+        template<typename F>
+        size_t scan(F &&fn) const {
+            const size_t size = file.size();
+            if (size <= sizeof(detail::LogHeader)) return std::min(size, sizeof(detail::LogHeader));
+            const detail::Mapping map(file, size, false);
+            map.advise(detail::Access::Sequential);
+            size_t at = sizeof(detail::LogHeader);
+            for (;;) {
+                detail::GroupHeader group;
+                if (size - at < sizeof(group)) break;
+                std::memcpy(&group, map.data() + at, sizeof(group));
+                const char *body = map.data() + at + sizeof(group);
+                if (group.bytes == 0 || group.bytes > size - at - sizeof(group) ||
+                    detail::fingerprint_bytes(body, group.bytes) != group.checksum)
+                    break;
+                fn(body, group.bytes);
+                at += sizeof(group) + group.bytes;
+            }
+            return at;
+        }
+
+        // Writes the buffered records as one group, syncing if asked, unless another thread gets there first;
+        // returns once every operation buffered before the call is written (and on the device if asked).
+        void flush(const bool sync) {
+            std::unique_lock guard(lock);
+            const uint64_t target = appended;
+            while ((sync ? durable : written) < target) {
+                if (busy) {
+                    done.wait(guard);
+                    continue;
+                }
+                busy = true;
+                std::string body = std::move(pending);
+                pending.clear();
+                const uint64_t upto = appended;
+                const size_t offset = end;
+                guard.unlock();
+                size_t size = 0;
+                try {
+                    if (!body.empty()) {
+                        const detail::GroupHeader group{body.size(),
+                                                        detail::fingerprint_bytes(body.data(), body.size())};
+                        file.write_at(&group, sizeof(group), offset);
+                        file.write_at(body.data(), body.size(), offset + sizeof(group));
+                        size = sizeof(group) + body.size();
+                    }
+                    if (sync) file.sync();
+                } catch (...) {
+                    // the records go back in front of the buffer for the next attempt
+                    guard.lock();
+                    pending.insert(0, body);
+                    busy = false;
+                    done.notify_all();
+                    throw;
+                }
+                guard.lock();
+                end = offset + size;
+                written = upto;
+                if (sync) durable = upto;
+                busy = false;
+                done.notify_all();
+            }
+        }
+
+        void record(const Op op, const std::span<const T> values) {
+            if (values.empty()) return;
+            bool full;
+            {
+                std::lock_guard guard(lock);
+                pending.push_back(static_cast<char>(op));
+                detail::put_varint(pending, values.size());
+                for (const auto &value: values) encode(pending, value);
+                appended += values.size();
+                full = pending.size() >= group_bytes;
+            }
+            if (full) flush(false);
+        }
+
+    public:
+        // Opens the log at path, creating it (for the given epoch) if it does not exist. Throws if the file holds
+        // something other than a log of T.
+        explicit OpLog(std::string path, const uint64_t epoch = 0) : path(std::move(path)), file(this->path) {
+            detail::LogHeader header;
+            if (file.size() < sizeof(header)) {
+                header = header_for(epoch);
+                file.resize(0);
+                file.write_at(&header, sizeof(header), 0);
+                file.sync();
+            } else {
+                file.read_at(&header, sizeof(header), 0);
+                if (header.magic != detail::LogHeader::magic_number)
+                    throw std::runtime_error("Not an operation log: " + this->path);
+                if (header.version != detail::LogHeader::current_version)
+                    throw std::runtime_error("Unsupported log version " + std::to_string(header.version));
+                if (header.type != detail::type_code<T>() || header.element_size != sizeof(T))
+                    throw std::runtime_error("Log holds another element type");
+            }
+            current_epoch = header.epoch;
+            end = scan([](const char *, size_t) {});
+            if (end < file.size()) file.resize(end); // a torn last group
+        }
+
+        OpLog(const OpLog &) = delete;
+
+        OpLog &operator=(const OpLog &) = delete;
+
+        uint64_t epoch() const { return current_epoch; }
+
+        // bytes of the log file, buffered records not included
+        size_t bytes() const {
+            std::lock_guard guard(lock);
+            return end;
+        }
+
+        // size from which the buffer is written out without a commit
+        void set_group_bytes(const size_t bytes) {
+            std::lock_guard guard(lock);
+            group_bytes = std::max<size_t>(bytes, 1);
+        }
+
+        /* Logging */
+
+        void add(const T &value) { record(Op::Add, std::span<const T>(&value, 1)); }
+
+        void add_all(const std::span<const T> values) { record(Op::Add, values); }
+
+        void remove(const T &value) { record(Op::Remove, std::span<const T>(&value, 1)); }
+
+        void remove_all(const std::span<const T> values) { record(Op::Remove, values); }
+
+        // returns once every operation logged before the call is on the device
+        void commit() { flush(true); }
+
+        // Calls fn(Op, std::vector<T> &&values) for every run of operations of the same kind in the file, in
+        // order, and returns how many operations there were. Operations not written yet are not replayed.
+        template<typename F>
+        size_t replay(F &&fn) const {
+            std::lock_guard guard(lock);
+            size_t count = 0;
+            Op op = Op::Add;
+            std::vector<T> run;
+            scan([&](const char *body, const size_t bytes) {
+                for (const char *p = body, *last = body + bytes; p < last;) {
+                    const auto next = static_cast<Op>(*p++);
+                    if (next != Op::Add && next != Op::Remove) throw std::runtime_error("Corrupt log record");
+                    if (next != op && !run.empty()) {
+                        fn(op, std::move(run));
+                        run.clear();
+                    }
+                    op = next;
+                    const uint64_t n = detail::get_varint(p, last);
+                    for (uint64_t i = 0; i < n; ++i) run.push_back(decode(p, last));
+                    count += n;
+                }
+            });
+            if (!run.empty()) fn(op, std::move(run));
+            return count;
+        }
+
+        // Empties the log and starts the given epoch, dropping the records not written yet too: for after a
+        // checkpoint that holds every operation so far. The new file replaces the old one by a rename.
+        void reset(const uint64_t epoch) {
+            std::unique_lock guard(lock);
+            done.wait(guard, [this] { return !busy; });
+            const std::string next = path + ".tmp";
+            std::filesystem::remove(next);
+            detail::File fresh(next);
+            const auto header = header_for(epoch);
+            fresh.write_at(&header, sizeof(header), 0);
+            fresh.sync();
+            std::filesystem::rename(next, path);
+            sync_directory(path);
+            file = std::move(fresh);
+            current_epoch = epoch;
+            end = sizeof(header);
+            pending.clear();
+            written = durable = appended;
+        }
+
+        // makes renames into the directory of path durable
+        static void sync_directory(const std::string &path) {
+            detail::sync_directory(std::filesystem::absolute(path).parent_path().string());
+        }
+    };
+
+    /* Journaled container */
+
+    // A container whose adds and removes go through an OpLog, with checkpoints: a snapshot of the elements
+    // (their epoch, then a save() snapshot) after which the log starts over. Opening one recovers the state of
+    // the last commit: the last checkpoint is loaded and the log of the same epoch replayed on top of it in
+    // bulk. A log of an older epoch is what a crash halfway through a checkpoint leaves, and is dropped.
+    // Changes are visible at once and durable after commit(); the container is not thread-safe by itself.
+    template<detail::serializable T>
+    class JournaledContainer {
+        std::string snapshot_path;
+        MyContainer<T> c;
+        uint64_t epoch = 0;
+        std::unique_ptr<OpLog<T>> log;
+
+        // Applies the log as one remove_all and one add_all. A remove takes out what was there before it: every
+        // element of the checkpoint with its value, and the values added since up to that point. So the adds are
+        // gathered, the last remove of every value remembers how many adds came before it, and an add survives
+        // unless a remove of its value comes after it.
+        void replay() {
+            using Op = typename OpLog<T>::Op;
+            std::vector<T> added;
+            std::unordered_map<T, size_t> removed; // value -> adds before its last remove
+            log->replay([&](const Op op, std::vector<T> &&values) {
+                if (op == Op::Add) {
+                    if (added.empty()) added = std::move(values);
+                    else std::move(values.begin(), values.end(), std::back_inserter(added));
+                } else
+                    for (auto &value: values) removed.insert_or_assign(std::move(value), added.size());
+            });
+            if (!removed.empty()) {
+                std::vector<T> values;
+                values.reserve(removed.size());
+                for (const auto &[value, at]: removed) values.push_back(value);
+                c.remove_all(std::move(values));
+                size_t i = 0;
+                std::erase_if(added, [&](const T &value) {
+                    const size_t at = i++;
+                    const auto found = removed.find(value);
+                    return found != removed.end() && at < found->second;
+                });
+            }
+            c.add_all(std::move(added));
+        }
+
+    public:
+        JournaledContainer(std::string snapshot, const std::string &log_path) : snapshot_path(std::move(snapshot)) {
+            if (std::filesystem::exists(snapshot_path)) {
+                std::ifstream is(snapshot_path, std::ios::binary);
+                if (!is) throw std::runtime_error("Cannot open " + snapshot_path);
+                detail::read_bytes(is, &epoch, sizeof(epoch));
+                c = MyContainer<T>::load(is);
+            }
+            log = std::make_unique<OpLog<T>>(log_path, epoch);
+            if (log->epoch() > epoch) throw std::runtime_error("Log " + log_path + " is newer than its checkpoint");
+            if (log->epoch() < epoch) log->reset(epoch);
+            else replay();
+        }
+
+        // the elements (copy it for the orders: copies share the elements until the next change)
+        const MyContainer<T> &container() const { return c; }
+
+        size_t size() const { return c.size(); }
+
+        OpLog<T> &get_log() { return *log; }
+
+        /* Element Modify methods */
+
+        void add(const T &value) {
+            log->add(value);
+            c.add(value);
+        }
+
+        void add_all(std::vector<T> values) {
+            log->add_all(values);
+            c.add_all(std::move(values));
+        }
+
+        // as MyContainer::try_remove; only removes that find something are logged
+        size_t try_remove(const T &value) {
+            const size_t removed = c.try_remove(value);
+            if (removed) log->remove(value);
+            return removed;
+        }
+
+        void remove(const T &value) {
+            if (!try_remove(value)) throw std::runtime_error("Value not found in container");
+        }
+
+        size_t remove_all(std::vector<T> values) {
+            log->remove_all(values);
+            return c.remove_all(std::move(values));
+        }
+
+        /* Durability */
+
+        void commit() { log->commit(); }
+
+        // Saves a snapshot of the elements (with their sorted index if asked, see save()) as the next epoch and
+        // empties the log. The snapshot replaces the last one by a rename.
+        void checkpoint(const bool sorted_index = false) {
+            const std::string next = snapshot_path + ".tmp";
+            {
+                std::ofstream os(next, std::ios::binary | std::ios::trunc);
+                if (!os) throw std::runtime_error("Cannot open " + next);
+                const uint64_t stamp = epoch + 1;
+                detail::write_bytes(os, &stamp, sizeof(stamp));
+                c.save(os, sorted_index);
+                os.flush();
+                if (!os) throw std::runtime_error("Cannot write " + next);
+            }
+            detail::File(next).sync();
+            std::filesystem::rename(next, snapshot_path);
+            OpLog<T>::sync_directory(snapshot_path);
+            log->reset(++epoch);
+        }
+    };
+} // namespace containers
+
+#endif //OPLOG_HPP
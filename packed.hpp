@@ -0,0 +1,300 @@
+#ifndef PACKED_HPP
+#define PACKED_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "containers.hpp"
+
+namespace containers {
+    /* Packed container */
+
+    // Container of ints stored compressed: every full block of 128 elements is kept as offsets from the
+    // block's minimum, bit-packed at the width of the largest offset (see simd::pack), which makes small
+    // ranges and repeats cost a few bits per element. The last partial block stays plain until it fills up.
+    // Insertion orders unpack one block at a time as they walk; the sorted orders are MyContainer's, over a
+    // sorted index unpacked and sorted on first use. Storage is copy-on-write like MyContainer's.
+    class PackedContainer {
+        static constexpr size_t block = simd::pack_block;
+
+        struct Block {
+            int base = 0;
+            uint32_t width = 0;
+            size_t offset = 0; // first word
+        };
+
+        struct Storage {
+            std::vector<uint32_t> words;
+            std::vector<Block> blocks;
+            std::vector<int> tail; // fewer than 128, not packed yet
+
+            size_t size() const { return blocks.size() * block + tail.size(); }
+
+            void unpack(const size_t b, int *out) const {
+                const auto &k = blocks[b];
+                simd::unpack(words.data() + k.offset, k.width, k.base, out);
+            }
+
+            // packs a full block of values at the end
+            void pack(const int *values) {
+                const auto [lo, hi] = std::minmax_element(values, values + block);
+                // in unsigned arithmetic: the range of a block may not fit an int
+                const auto width = static_cast<uint32_t>(std::bit_width(static_cast<uint32_t>(*hi) -
+                                                                        static_cast<uint32_t>(*lo)));
+                blocks.push_back({*lo, width, words.size()});
+                words.resize(words.size() + simd::packed_words(width));
+                simd::pack(values, *lo, width, words.data() + blocks.back().offset);
+            }
+        };
+
+        std::shared_ptr<Storage> data = std::make_shared<Storage>();
+        Parallelism parallelism;
+        size_t generation = 0;
+
+        struct Cache {
+            size_t generation = 0;
+            View<int> sorted;
+        };
+
+        mutable Cache cache;
+
+        Storage &detach() {
+            if (data.use_count() > 1) data = std::make_shared<Storage>(*data);
+            ++generation;
+            return *data;
+        }
+
+        // calls fn(const int *, size_t) on the elements a block (or the tail) at a time
+        template<typename F>
+        static void for_each_run(const Storage &s, F &&fn) {
+            std::array<int, block> buffer;
+            for (size_t b = 0; b < s.blocks.size(); ++b) {
+                s.unpack(b, buffer.data());
+                fn(buffer.data(), block);
+            }
+            fn(s.tail.data(), s.tail.size());
+        }
+
+        // values the block may hold, from its frame
+        static bool may_hold(const Block &k, const int value) {
+            const uint32_t offset = static_cast<uint32_t>(value) - static_cast<uint32_t>(k.base);
+            return k.width == 32 || offset >> k.width == 0;
+        }
+
+        const View<int> &sorted_view() const {
+            if (cache.generation != generation || !cache.sorted)
+                cache = {generation, std::make_shared<const std::vector<int>>(sorted_values(parallelism))};
+            return cache.sorted;
+        }
+
+        std::vector<int> sorted_values(const Parallelism &p) const {
+            std::vector<int> all;
+            all.reserve(data->size());
+            for_each_run(*data, [&](const int *run, const size_t n) { all.insert(all.end(), run, run + n); });
+            detail::sort(all, p);
+            return all;
+        }
+
+    public:
+        /* Element Modify methods */
+
+        void add(const int value) {
+            auto &s = detach();
+            s.tail.push_back(value);
+            if (s.tail.size() == block) {
+                s.pack(s.tail.data());
+                s.tail.clear();
+            }
+        }
+
+        // appends values in order, as one modification
+        void add_all(const std::span<const int> values) {
+            if (values.empty()) return;
+            auto &s = detach();
+            size_t i = 0;
+            if (!s.tail.empty()) {
+                i = std::min(values.size(), block - s.tail.size());
+                s.tail.insert(s.tail.end(), values.begin(), values.begin() + static_cast<ptrdiff_t>(i));
+                if (s.tail.size() < block) return;
+                s.pack(s.tail.data());
+                s.tail.clear();
+            }
+            for (; i + block <= values.size(); i += block) s.pack(values.data() + i);
+            s.tail.assign(values.begin() + static_cast<ptrdiff_t>(i), values.end());
+        }
+
+        void remove(const int value) {
+            if (!try_remove(value)) throw std::runtime_error("Value not found in container");
+        }
+
+        // removes every occurrence of value (repacking the blocks from the first one holding it on), returns
+        // how many there were
+        size_t try_remove(const int value) {
+            std::array<int, block> buffer;
+            const auto &s = *data;
+            size_t b = 0;
+            for (; b < s.blocks.size(); ++b) {
+                if (!may_hold(s.blocks[b], value)) continue;
+                s.unpack(b, buffer.data());
+                if (std::find(buffer.begin(), buffer.end(), value) != buffer.end()) break;
+            }
+            if (b == s.blocks.size() && !detail::contains(s.tail, value)) return 0;
+
+            std::vector<int> rest;
+            rest.reserve((s.blocks.size() - b) * block + s.tail.size());
+            for (size_t k = b; k < s.blocks.size(); ++k) {
+                s.unpack(k, buffer.data());
+                rest.insert(rest.end(), buffer.begin(), buffer.end());
+            }
+            rest.insert(rest.end(), s.tail.begin(), s.tail.end());
+            const size_t removed = detail::remove(rest, value);
+
+            auto next = std::make_shared<Storage>();
+            next->blocks.assign(s.blocks.begin(), s.blocks.begin() + static_cast<ptrdiff_t>(b));
+            next->words.assign(s.words.begin(), s.words.begin() + static_cast<ptrdiff_t>(
+                                                    b < s.blocks.size() ? s.blocks[b].offset : s.words.size()));
+            data = std::move(next);
+            ++generation;
+            add_all(rest);
+            return removed;
+        }
+
+        size_t size() const { return data->size(); }
+
+        // bytes held by the elements (packed words, block frames and the plain tail)
+        size_t memory_bytes() const {
+            return data->words.capacity() * sizeof(uint32_t) + data->blocks.capacity() * sizeof(Block) +
+                   data->tail.capacity() * sizeof(int);
+        }
+
+        // gives back the spare capacity appends leave behind
+        void shrink_to_fit() {
+            // iterators may be reading this storage; a copy is tight already
+            if (data.use_count() > 1) {
+                data = std::make_shared<Storage>(*data);
+                return;
+            }
+            auto &s = *data;
+            s.words.shrink_to_fit();
+            s.blocks.shrink_to_fit();
+            s.tail.shrink_to_fit();
+        }
+
+        /* Search (blocks whose frame cannot hold the value are skipped unpacked) */
+
+        bool contains(const int value) const { return count(value) > 0; }
+
+        size_t count(const int value) const {
+            std::array<int, block> buffer;
+            const auto &s = *data;
+            size_t n = 0;
+            for (size_t b = 0; b < s.blocks.size(); ++b) {
+                if (!may_hold(s.blocks[b], value)) continue;
+                s.unpack(b, buffer.data());
+                n += simd::count(buffer.data(), block, value);
+            }
+            return n + detail::count(s.tail, value);
+        }
+
+        /* Parallelism (used by the sort behind the sorted orders) */
+
+        const Parallelism &get_parallelism() const { return parallelism; }
+
+        void set_parallelism(const Parallelism &p) { parallelism = p; }
+
+        int operator[](const size_t index) const {
+            if (index >= size()) throw std::runtime_error("Index out of range");
+            const auto &s = *data;
+            if (index >= s.blocks.size() * block) return s.tail[index - s.blocks.size() * block];
+            std::array<int, block> buffer;
+            s.unpack(index / block, buffer.data());
+            return buffer[index % block];
+        }
+
+        friend std::ostream &operator<<(std::ostream &os, const PackedContainer &c) {
+            for_each_run(*c.data, [&](const int *run, const size_t n) {
+                for (size_t i = 0; i < n; ++i) os << run[i] << " ";
+            });
+            return os;
+        }
+
+        /* Iterators */
+
+        // Walks the elements as of its creation in insertion or reverse order, keeping the last block it
+        // unpacked, so a walk unpacks every block once.
+        class Iterator : public WalkIterator<Iterator, int> {
+            friend class WalkIterator<Iterator, int>;
+
+        protected:
+            std::shared_ptr<const Storage> data;
+            mutable size_t cached = SIZE_MAX;
+            mutable std::array<int, block> buffer{};
+
+            // where element at is, unpacking its block if needed: only valid until another block is unpacked
+            const int *locate(const size_t at) const {
+                const size_t packed = data->blocks.size() * block;
+                if (at >= packed) return &data->tail[at - packed];
+                if (at / block != cached) {
+                    cached = at / block;
+                    data->unpack(cached, buffer.data());
+                }
+                return &buffer[at % block];
+            }
+
+            int element(const size_t at) const { return *locate(at); }
+
+            // forward walks hand out the unpacked blocks themselves
+            std::span<const int> run(const size_t at) const {
+                const size_t packed = data->blocks.size() * block;
+                return {locate(at), (at < packed ? (at / block + 1) * block : size()) - at};
+            }
+
+        public:
+            Iterator(const PackedContainer &c, const Walk walk) : WalkIterator(walk), data(c.data) {}
+
+            size_t size() const { return data->size(); }
+
+            bool operator==(const Iterator &other) const {
+                if (pos != other.pos || walk != other.walk || size() != other.size()) return false;
+                if (data == other.data) return true;
+                for (size_t i = 0; i < size(); ++i)
+                    if (element(i) != other.element(i)) return false;
+                return true;
+            }
+        };
+
+        using Order = WalkOrder<Iterator, Walk::Forward>;
+        using ReverseOrder = WalkOrder<Iterator, Walk::Backward>;
+
+        // the sorted orders walk the sorted index, unpacked and sorted once per modification
+        using AscendingOrder = MyContainer<int>::AscendingOrder;
+        using DescendingOrder = MyContainer<int>::DescendingOrder;
+        using SideCrossOrder = MyContainer<int>::SideCrossOrder;
+        using MiddleOutOrder = MyContainer<int>::MiddleOutOrder;
+
+        Order begin_order() const { return at_begin(Order(*this)); }
+        Order end_order() const { return at_end(Order(*this)); }
+
+        ReverseOrder begin_reverse_order() const { return at_begin(ReverseOrder(*this)); }
+        ReverseOrder end_reverse_order() const { return at_end(ReverseOrder(*this)); }
+
+        AscendingOrder begin_ascending_order() const { return at_begin(AscendingOrder(sorted_view())); }
+        AscendingOrder end_ascending_order() const { return at_end(AscendingOrder(sorted_view())); }
+
+        DescendingOrder begin_descending_order() const { return at_begin(DescendingOrder(sorted_view())); }
+        DescendingOrder end_descending_order() const { return at_end(DescendingOrder(sorted_view())); }
+
+        SideCrossOrder begin_side_cross_order() const { return at_begin(SideCrossOrder(sorted_view())); }
+        SideCrossOrder end_side_cross_order() const { return at_end(SideCrossOrder(sorted_view())); }
+
+        MiddleOutOrder begin_middle_out_order() const { return at_begin(MiddleOutOrder(sorted_view())); }
+        MiddleOutOrder end_middle_out_order() const { return at_end(MiddleOutOrder(sorted_view())); }
+    };
+} // namespace containers
+
+#endif //PACKED_HPP
@@ -0,0 +1,119 @@
+#include "parallel.hpp"
+
+#include <utility>
+
+namespace containers {
+    namespace {
+        thread_local const ThreadPool *current_pool = nullptr;
+        thread_local size_t current_worker = 0;
+    }
+
+    /* ThreadPool */
+
+    ThreadPool::ThreadPool(const size_t threads) {
+        const size_t n = std::max<size_t>(threads, 1);
+        for (size_t i = 0; i < n; ++i) queues.push_back(std::make_unique<Queue>());
+        for (size_t i = 0; i < n; ++i) workers.emplace_back([this, i] { work(i); });
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard guard(sleep_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &w: workers) w.join();
+    }
+
+    void ThreadPool::submit(Task task) {
+        const size_t i = current_pool == this ? current_worker : next++ % queues.size();
+        {
+            std::lock_guard guard(queues[i]->lock);
+            queues[i]->tasks.push_back(std::move(task));
+        }
+        queued++;
+        // pairs with the predicate check in work(), so a worker about to sleep cannot miss the task
+        { std::lock_guard guard(sleep_lock); }
+        wake.notify_one();
+    }
+
+    bool ThreadPool::run_pending() {
+        Task task;
+        if (!pop(current_pool == this ? current_worker : 0, task)) return false;
+        task();
+        return true;
+    }
+
+    ThreadPool &ThreadPool::shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    bool ThreadPool::pop(const size_t self, Task &task) {
+        if (queued.load() == 0) return false;
+        if (current_pool == this) {
+            // own deque: newest first
+            std::lock_guard guard(queues[self]->lock);
+            if (auto &own = queues[self]->tasks; !own.empty()) {
+                task = std::move(own.back());
+                own.pop_back();
+                queued--;
+                return true;
+            }
+        }
+        // steal: oldest first
+        for (size_t k = 0; k < queues.size(); ++k) {
+            auto &q = *queues[(self + k) % queues.size()];
+            std::lock_guard guard(q.lock);
+            if (!q.tasks.empty()) {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+                queued--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::work(const size_t self) {
+        current_pool = this;
+        current_worker = self;
+        Task task;
+        while (true) {
+            if (pop(self, task)) {
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock lock(sleep_lock);
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            if (stopping && queued.load() == 0) return;
+        }
+    }
+
+    /* TaskGroup */
+
+    void TaskGroup::run(std::function<void()> task) {
+        pending++;
+        pool.submit([this, task = std::move(task)] {
+            try {
+                task();
+            } catch (...) {
+                std::lock_guard guard(error_lock);
+                if (!error) error = std::current_exception();
+            }
+            pending--;
+        });
+    }
+
+    void TaskGroup::wait() {
+        join();
+        std::lock_guard guard(error_lock);
+        if (error) std::rethrow_exception(std::exchange(error, nullptr));
+    }
+
+    void TaskGroup::join() {
+        while (pending.load() > 0)
+            if (!pool.run_pending()) std::this_thread::yield();
+    }
+} // namespace containers
@@ -0,0 +1,187 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace containers {
+    /* Configuration */
+
+    struct Parallelism {
+        static size_t hardware_threads() { return std::max<size_t>(1, std::thread::hardware_concurrency()); }
+
+        // Upper bound on the threads one operation may use. Work runs on ThreadPool::shared() plus the calling
+        // thread, so at most hardware_threads() + 1 of them run at once: a larger count only splits the work
+        // into more pieces.
+        size_t threads = hardware_threads();
+        size_t threshold = 1 << 20; // element count from which operations go parallel
+
+        bool applies(const size_t n) const { return threads > 1 && n >= threshold; }
+    };
+
+    /* Work-stealing thread pool */
+
+    class ThreadPool {
+    public:
+        using Task = std::function<void()>;
+
+        explicit ThreadPool(size_t threads = Parallelism::hardware_threads());
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        ~ThreadPool();
+
+        size_t size() const { return workers.size(); }
+
+        // queues a task; tasks submitted from a worker go to that worker's own deque
+        void submit(Task task);
+
+        // runs one queued task on the calling thread; false if there was none
+        bool run_pending();
+
+        // process-wide pool, one worker per hardware thread; every Parallelism runs here, whatever its threads
+        static ThreadPool &shared();
+
+    private:
+        struct Queue {
+            std::mutex lock;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<size_t> queued{0}, next{0};
+        std::mutex sleep_lock;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        bool pop(size_t self, Task &task);
+
+        void work(size_t self);
+    };
+
+    // fork-join scope over a pool: run() tasks, then wait() for them while helping to execute queued work
+    class TaskGroup {
+    public:
+        explicit TaskGroup(ThreadPool &pool = ThreadPool::shared()) : pool(pool) {}
+
+        TaskGroup(const TaskGroup &) = delete;
+
+        TaskGroup &operator=(const TaskGroup &) = delete;
+
+        ~TaskGroup() { join(); }
+
+        void run(std::function<void()> task);
+
+        // blocks until every task of the group finished, then rethrows the first exception one of them threw
+        void wait();
+
+    private:
+        ThreadPool &pool;
+        std::atomic<size_t> pending{0};
+        std::mutex error_lock;
+        std::exception_ptr error;
+
+        void join();
+    };
+
+    /* Algorithms */
+
+    // calls fn(begin, end) over [0, n) in chunks of grain indices, claimed dynamically by at most `threads` workers
+    template<typename F>
+    void parallel_for(const size_t n, size_t grain, const size_t threads, F &&fn) {
+        grain = std::max<size_t>(grain, 1);
+        const size_t tasks = std::min(std::max<size_t>(threads, 1), (n + grain - 1) / grain);
+        if (tasks <= 1) {
+            if (n) fn(size_t{0}, n);
+            return;
+        }
+        std::atomic<size_t> next{0};
+        const auto body = [&] {
+            for (size_t b; (b = next.fetch_add(grain)) < n;) fn(b, std::min(n, b + grain));
+        };
+        TaskGroup group;
+        for (size_t t = 1; t < tasks; ++t) group.run(body);
+        body();
+        group.wait();
+    }
+
+    namespace detail {
+        // number of elements taken from a by the first k outputs of a stable merge of a and b
+        template<typename T>
+        size_t merge_co_rank(const size_t k, const T *a, const size_t na, const T *b, const size_t nb) {
+            size_t lo = k > nb ? k - nb : 0, hi = std::min(k, na);
+            while (true) {
+                const size_t i = lo + (hi - lo) / 2, j = k - i;
+                if (i < na && j > 0 && !(b[j - 1] < a[i])) lo = i + 1;
+                else if (i > 0 && j < nb && b[j] < a[i - 1]) hi = i - 1;
+                else return i;
+            }
+        }
+    } // namespace detail
+
+    // Sorts [first, first + n) by sorting `threads` runs with sort_run(T *, size_t) in parallel, then merging
+    // them pairwise, every merge split into independent pieces along the merge path. The runs follow the thread
+    // count and sort_run need not be stable, so elements that compare equal but differ (-0.0 and 0.0, say) may
+    // come out in a different order for a different thread count; the output is sorted either way.
+    template<typename T, typename Sort>
+    void parallel_sort(T *first, const size_t n, const size_t threads, Sort &&sort_run) {
+        constexpr size_t min_run = 1 << 12;
+        const size_t runs = std::min(threads, n / min_run);
+        if (runs <= 1) {
+            sort_run(first, n);
+            return;
+        }
+
+        std::vector<size_t> bounds(runs + 1);
+        for (size_t r = 0; r <= runs; ++r) bounds[r] = n * r / runs;
+        parallel_for(runs, 1, threads, [&](const size_t b, const size_t e) {
+            for (size_t r = b; r < e; ++r) sort_run(first + bounds[r], bounds[r + 1] - bounds[r]);
+        });
+
+        std::vector<T> buffer(n);
+        T *src = first, *dst = buffer.data();
+        std::vector<std::function<void()>> jobs;
+        for (size_t width = 1; width < runs; width *= 2) {
+            jobs.clear();
+            const size_t pieces = std::max<size_t>(1, threads * 2 * width / runs);
+            for (size_t r = 0; r < runs; r += 2 * width) {
+                const size_t lo = bounds[r], mid = bounds[std::min(r + width, runs)];
+                const size_t hi = bounds[std::min(r + 2 * width, runs)];
+                // split points are found before any piece starts moving elements out of src
+                const size_t na = mid - lo, nb = hi - mid;
+                size_t k0 = 0, i0 = 0;
+                for (size_t p = 1; p <= pieces; ++p) {
+                    const size_t k1 = (na + nb) * p / pieces;
+                    const size_t i1 = detail::merge_co_rank(k1, src + lo, na, src + mid, nb);
+                    jobs.emplace_back([=] {
+                        std::merge(std::make_move_iterator(src + lo + i0), std::make_move_iterator(src + lo + i1),
+                                   std::make_move_iterator(src + mid + (k0 - i0)),
+                                   std::make_move_iterator(src + mid + (k1 - i1)), dst + lo + k0);
+                    });
+                    k0 = k1;
+                    i0 = i1;
+                }
+            }
+            parallel_for(jobs.size(), 1, threads, [&](const size_t b, const size_t e) {
+                for (size_t j = b; j < e; ++j) jobs[j]();
+            });
+            std::swap(src, dst);
+        }
+        if (src != first) std::move(src, src + n, first);
+    }
+} // namespace containers
+
+#endif //PARALLEL_HPP
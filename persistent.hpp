@@ -0,0 +1,270 @@
+#ifndef PERSISTENT_HPP
+#define PERSISTENT_HPP
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "containers.hpp"
+
+namespace containers {
+    /* Persistent container */
+
+    // Immutable, versioned container: add and remove return a new version and leave this one intact. The
+    // elements sit in chunks of up to 64 at the leaves of a relaxed radix-balanced tree, so a new version
+    // copies one root-to-leaf path (or, for remove, the paths to the chunks that changed) and shares
+    // everything else with the version it came from. Versions are safe to read from any number of threads.
+    template<typename T>
+    class PersistentContainer {
+        static constexpr size_t chunk = 64;
+
+        // leaves hold elements; inner nodes hold children and the running element count after each child
+        struct Node {
+            std::vector<T> elements;
+            std::vector<std::shared_ptr<const Node>> children;
+            std::vector<size_t> ends;
+        };
+
+        using Ptr = std::shared_ptr<const Node>;
+
+        // sorted once per version, by whichever reader asks first
+        struct Sorting {
+            std::once_flag once;
+            View<T> sorted;
+        };
+
+        Ptr root;
+        size_t height = 0, count = 0;
+        Parallelism parallelism;
+        std::shared_ptr<Sorting> sorting = std::make_shared<Sorting>();
+
+        PersistentContainer(Ptr root, const size_t height, const size_t count, const Parallelism &p)
+            : root(std::move(root)), height(height), count(count), parallelism(p) {}
+
+        static Ptr path(const size_t height, const T &value) {
+            auto node = std::make_shared<Node>();
+            if (height == 0) node->elements.push_back(value);
+            else {
+                node->children.push_back(path(height - 1, value));
+                node->ends.push_back(1);
+            }
+            return node;
+        }
+
+        // node with value appended, nullptr if its subtree is full
+        static Ptr push(const Node &node, const size_t height, const T &value) {
+            if (height == 0) {
+                if (node.elements.size() == chunk) return nullptr;
+                auto leaf = std::make_shared<Node>(node);
+                leaf->elements.push_back(value);
+                return leaf;
+            }
+            Ptr last = push(*node.children.back(), height - 1, value);
+            if (!last && node.children.size() == chunk) return nullptr;
+            auto inner = std::make_shared<Node>(node);
+            if (last) inner->children.back() = std::move(last);
+            else {
+                inner->children.push_back(path(height - 1, value));
+                inner->ends.push_back(inner->ends.back());
+            }
+            ++inner->ends.back();
+            return inner;
+        }
+
+        // node without the elements equal to value (the same node if there were none, nullptr if nothing is left)
+        static Ptr without(const Ptr &node, const size_t height, const T &value, size_t &removed) {
+            if (height == 0) {
+                if (!detail::contains(node->elements, value)) return node;
+                auto kept = node->elements;
+                const size_t n = detail::remove(kept, value);
+                removed += n;
+                if (kept.empty()) return nullptr;
+                auto leaf = std::make_shared<Node>();
+                leaf->elements = std::move(kept);
+                return leaf;
+            }
+            // copied from the first child that loses elements on; the children before it are kept as they are
+            std::shared_ptr<Node> inner;
+            for (size_t k = 0; k < node->children.size(); ++k) {
+                const size_t before = removed;
+                Ptr c = without(node->children[k], height - 1, value, removed);
+                if (!inner) {
+                    if (removed == before) continue;
+                    inner = std::make_shared<Node>();
+                    inner->children.assign(node->children.begin(), node->children.begin() + k);
+                    inner->ends.assign(node->ends.begin(), node->ends.begin() + k);
+                }
+                if (!c) continue;
+                const size_t n = size_of(*c, height - 1);
+                inner->ends.push_back((inner->ends.empty() ? 0 : inner->ends.back()) + n);
+                inner->children.push_back(std::move(c));
+            }
+            if (!inner) return node;
+            if (inner->children.empty()) return nullptr;
+            return inner;
+        }
+
+        static size_t size_of(const Node &node, const size_t height) {
+            return height == 0 ? node.elements.size() : node.ends.back();
+        }
+
+        // leaf holding element i of a tree, and the index of its first element
+        static std::pair<const Node *, size_t> leaf_at(const Node *node, const size_t height, size_t i) {
+            size_t first = 0;
+            for (size_t h = height; h > 0; --h) {
+                const size_t k = std::upper_bound(node->ends.begin(), node->ends.end(), i) - node->ends.begin();
+                const size_t before = k ? node->ends[k - 1] : 0;
+                first += before;
+                i -= before;
+                node = node->children[k].get();
+            }
+            return {node, first};
+        }
+
+        template<typename F>
+        static void for_each_leaf(const Node &node, const size_t height, F &&fn) {
+            if (height == 0) fn(node.elements);
+            else for (const auto &c: node.children) for_each_leaf(*c, height - 1, fn);
+        }
+
+        const View<T> &sorted_view() const {
+            std::call_once(sorting->once, [this] {
+                std::vector<T> all;
+                all.reserve(count);
+                if (root)
+                    for_each_leaf(*root, height, [&](const auto &e) { all.insert(all.end(), e.begin(), e.end()); });
+                detail::sort(all, parallelism);
+                sorting->sorted = std::make_shared<const std::vector<T>>(std::move(all));
+            });
+            return sorting->sorted;
+        }
+
+    public:
+        PersistentContainer() = default;
+
+        /* Versions (this one stays as it is) */
+
+        [[nodiscard]] PersistentContainer add(const T &value) const {
+            if (!root) return {path(0, value), 0, 1, parallelism};
+            if (Ptr next = push(*root, height, value)) return {std::move(next), height, count + 1, parallelism};
+            // full: the tree grows one level
+            auto grown = std::make_shared<Node>();
+            grown->children = {root, path(height, value)};
+            grown->ends = {count, count + 1};
+            return {std::move(grown), height + 1, count + 1, parallelism};
+        }
+
+        // version without any element equal to value; throws if there is none
+        [[nodiscard]] PersistentContainer remove(const T &value) const {
+            auto next = try_remove(value);
+            if (next.count == count) throw std::runtime_error("Value not found in container");
+            return next;
+        }
+
+        // version without any element equal to value (this one if there is none)
+        [[nodiscard]] PersistentContainer try_remove(const T &value) const {
+            if (!root) return *this;
+            size_t removed = 0;
+            Ptr next = without(root, height, value, removed);
+            if (!removed) return *this;
+            size_t h = next ? height : 0;
+            while (h > 0 && next->children.size() == 1) {
+                next = next->children.front();
+                --h;
+            }
+            return {std::move(next), h, count - removed, parallelism};
+        }
+
+        [[nodiscard]] PersistentContainer with_parallelism(const Parallelism &p) const {
+            return {root, height, count, p};
+        }
+
+        size_t size() const { return count; }
+
+        const T &operator[](const size_t index) const {
+            if (index >= count) throw std::runtime_error("Index out of range");
+            const auto [leaf, first] = leaf_at(root.get(), height, index);
+            return leaf->elements[index - first];
+        }
+
+        friend std::ostream &operator<<(std::ostream &os, const PersistentContainer &c) {
+            if (c.root)
+                for_each_leaf(*c.root, c.height, [&](const auto &e) {
+                    for (const auto &item: e) os << item << " ";
+                });
+            return os;
+        }
+
+        /* Iterators */
+
+        // Walks a version's tree in insertion or reverse order; the leaf of the last access is kept, so a
+        // sequential walk descends the tree once per chunk.
+        class Iterator : public WalkIterator<Iterator, const T &> {
+            friend class WalkIterator<Iterator, const T &>;
+
+        protected:
+            Ptr root;
+            size_t height = 0, count = 0;
+            mutable const Node *leaf = nullptr;
+            mutable size_t leaf_first = 0;
+
+            const T &element(const size_t at) const {
+                if (!leaf || at < leaf_first || at >= leaf_first + leaf->elements.size())
+                    std::tie(leaf, leaf_first) = leaf_at(root.get(), height, at);
+                return leaf->elements[at - leaf_first];
+            }
+
+            // forward walks hand out pieces of the leaves themselves
+            std::span<const T> run(const size_t at) const {
+                const T &x = element(at);
+                return {&x, leaf_first + leaf->elements.size() - at};
+            }
+
+        public:
+            Iterator(const PersistentContainer &c, const Walk walk)
+                : WalkIterator<Iterator, const T &>(walk), root(c.root), height(c.height), count(c.count) {}
+
+            size_t size() const { return count; }
+
+            bool operator==(const Iterator &other) const {
+                if (this->pos != other.pos || this->walk != other.walk || size() != other.size()) return false;
+                if (root == other.root) return true;
+                for (size_t i = 0; i < size(); ++i)
+                    if (!(element(i) == other.element(i))) return false;
+                return true;
+            }
+        };
+
+        using Order = WalkOrder<Iterator, Walk::Forward>;
+        using ReverseOrder = WalkOrder<Iterator, Walk::Backward>;
+
+        // the sorted orders walk the version's sorted index, built on first use and shared by its copies
+        using AscendingOrder = typename MyContainer<T>::AscendingOrder;
+        using DescendingOrder = typename MyContainer<T>::DescendingOrder;
+        using SideCrossOrder = typename MyContainer<T>::SideCrossOrder;
+        using MiddleOutOrder = typename MyContainer<T>::MiddleOutOrder;
+
+        Order begin_order() const { return at_begin(Order(*this)); }
+        Order end_order() const { return at_end(Order(*this)); }
+
+        ReverseOrder begin_reverse_order() const { return at_begin(ReverseOrder(*this)); }
+        ReverseOrder end_reverse_order() const { return at_end(ReverseOrder(*this)); }
+
+        AscendingOrder begin_ascending_order() const { return at_begin(AscendingOrder(sorted_view())); }
+        AscendingOrder end_ascending_order() const { return at_end(AscendingOrder(sorted_view())); }
+
+        DescendingOrder begin_descending_order() const { return at_begin(DescendingOrder(sorted_view())); }
+        DescendingOrder end_descending_order() const { return at_end(DescendingOrder(sorted_view())); }
+
+        SideCrossOrder begin_side_cross_order() const { return at_begin(SideCrossOrder(sorted_view())); }
+        SideCrossOrder end_side_cross_order() const { return at_end(SideCrossOrder(sorted_view())); }
+
+        MiddleOutOrder begin_middle_out_order() const { return at_begin(MiddleOutOrder(sorted_view())); }
+        MiddleOutOrder end_middle_out_order() const { return at_end(MiddleOutOrder(sorted_view())); }
+    };
+} // namespace containers
+
+#endif //PERSISTENT_HPP
@@ -0,0 +1,450 @@
+#ifndef SHARDED_HPP
+#define SHARDED_HPP
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "containers.hpp"
+
+namespace containers {
+    /* Sharded container */
+
+    // Spreads the elements over independent MyContainer shards, each behind its own lock, so writers on
+    // different shards never contend. The insertion orders walk the shards one after another; the sorted
+    // orders merge the shards' sorted views lazily, one element per step, instead of re-sorting everything.
+    template<typename T>
+    class ShardedContainer {
+    public:
+        // how add() picks a shard: by calling thread (writers on different threads do not contend) or by
+        // value hash (remove, contains and count then visit one shard instead of all of them)
+        enum class Sharding { Thread, Hash };
+
+    private:
+        struct alignas(64) Shard {
+            mutable std::mutex lock;
+            MyContainer<T> elements;
+        };
+
+        std::vector<std::unique_ptr<Shard>> shards;
+        Sharding sharding;
+        Parallelism parallelism;
+
+        Shard &shard_for(const T &value) const {
+            const size_t h = sharding == Sharding::Hash
+                                 ? std::hash<T>{}(value)
+                                 : std::hash<std::thread::id>{}(std::this_thread::get_id());
+            return *shards[h % shards.size()];
+        }
+
+        // calls fn(MyContainer<T> &) on every shard value may be in, under that shard's lock
+        template<typename F>
+        void for_candidates(const T &value, F &&fn) const {
+            if (sharding == Sharding::Hash) {
+                auto &s = shard_for(value);
+                std::lock_guard guard(s.lock);
+                fn(s.elements);
+                return;
+            }
+            for (const auto &s: shards) {
+                std::lock_guard guard(s->lock);
+                fn(s->elements);
+            }
+        }
+
+        // one view per shard, each taken atomically under its shard's lock (sorted ones are sorted outside it)
+        struct Runs {
+            std::vector<View<T>> views;
+            std::vector<size_t> offsets; // elements in the shards before each shard, then the total
+
+            size_t size() const { return offsets.back(); }
+
+            bool operator==(const Runs &other) const {
+                if (views.size() != other.views.size()) return false;
+                for (size_t s = 0; s < views.size(); ++s)
+                    if (views[s] != other.views[s] && *views[s] != *other.views[s]) return false;
+                return true;
+            }
+        };
+
+        std::shared_ptr<const Runs> runs(const bool sorted) const {
+            auto r = std::make_shared<Runs>();
+            r->views.resize(shards.size());
+            // the lock only covers starting the sort (or finding it done) on the pool, so writers wait O(1);
+            // the shards sort independently of each other while this thread helps
+            std::vector<std::shared_future<View<T>>> sorting(shards.size());
+            for (size_t s = 0; s < shards.size(); ++s) {
+                std::lock_guard guard(shards[s]->lock);
+                if (sorted) sorting[s] = shards[s]->elements.prepare_sorted_async();
+                else r->views[s] = shards[s]->elements.elements();
+            }
+            if (sorted)
+                for (size_t s = 0; s < shards.size(); ++s) r->views[s] = detail::await(sorting[s]);
+            r->offsets.push_back(0);
+            for (const auto &v: r->views) r->offsets.push_back(r->offsets.back() + v->size());
+            return r;
+        }
+
+        // Lazy merge of sorted runs in one direction, from per-run split points: climbing takes
+        // views[r][at[r]++], descending takes views[r][--at[r]]. Equal elements are ordered by run, so both
+        // directions walk the same total order.
+        class Cursor {
+            const Runs *runs = nullptr;
+            bool up = true;
+            std::vector<size_t> at, heap;
+
+            const T &head(const size_t r) const { return (*runs->views[r])[up ? at[r] : at[r] - 1]; }
+
+            bool live(const size_t r) const { return up ? at[r] < runs->views[r]->size() : at[r] > 0; }
+
+            // heap order: whether run a's head comes out after run b's
+            bool after(const size_t a, const size_t b) const {
+                const T &x = head(a), &y = head(b);
+                if (up) return y < x || (!(x < y) && b < a);
+                return x < y || (!(y < x) && a < b);
+            }
+
+        public:
+            Cursor() = default;
+
+            Cursor(const Runs &runs, std::vector<size_t> from, const bool up)
+                : runs(&runs), up(up), at(std::move(from)) {
+                for (size_t r = 0; r < at.size(); ++r)
+                    if (live(r)) heap.push_back(r);
+                std::make_heap(heap.begin(), heap.end(), [this](auto a, auto b) { return after(a, b); });
+            }
+
+            const T &top() const { return head(heap.front()); }
+
+            void pop() {
+                const auto order = [this](auto a, auto b) { return after(a, b); };
+                std::pop_heap(heap.begin(), heap.end(), order);
+                const size_t r = heap.back();
+                up ? ++at[r] : --at[r];
+                if (live(r)) std::push_heap(heap.begin(), heap.end(), order);
+                else heap.pop_back();
+            }
+        };
+
+        // per-run counts of the m first elements of the merged order
+        static std::vector<size_t> split(const Runs &runs, const size_t m) {
+            const size_t k = runs.views.size();
+            // position of element i of run s in the merged order
+            const auto rank = [&](const size_t s, const size_t i) {
+                const T &v = (*runs.views[s])[i];
+                size_t r = i;
+                for (size_t t = 0; t < k; ++t) {
+                    const auto &w = *runs.views[t];
+                    if (t < s) r += std::upper_bound(w.begin(), w.end(), v) - w.begin();
+                    else if (t > s) r += std::lower_bound(w.begin(), w.end(), v) - w.begin();
+                }
+                return r;
+            };
+            std::vector<size_t> at(k);
+            for (size_t s = 0; s < k; ++s) {
+                size_t lo = 0, hi = runs.views[s]->size();
+                while (lo < hi) {
+                    const size_t mid = lo + (hi - lo) / 2;
+                    if (rank(s, mid) < m) lo = mid + 1;
+                    else hi = mid;
+                }
+                at[s] = lo;
+            }
+            return at;
+        }
+
+    public:
+        explicit ShardedContainer(const size_t shards = Parallelism::hardware_threads(),
+                                  const Sharding sharding = Sharding::Thread) : sharding(sharding) {
+            for (size_t s = 0; s < std::max<size_t>(shards, 1); ++s) this->shards.push_back(std::make_unique<Shard>());
+        }
+
+        ShardedContainer(const ShardedContainer &) = delete;
+
+        ShardedContainer &operator=(const ShardedContainer &) = delete;
+
+        size_t shard_count() const { return shards.size(); }
+
+        /* Element Modify methods (lock one shard, or one at a time) */
+
+        void add(const T &value) {
+            auto &s = shard_for(value);
+            std::lock_guard guard(s.lock);
+            s.elements.add(value);
+        }
+
+        void remove(const T &value) {
+            if (!try_remove(value)) throw std::runtime_error("Value not found in container");
+        }
+
+        // removes every occurrence of value, returns how many there were
+        size_t try_remove(const T &value) {
+            size_t removed = 0;
+            for_candidates(value, [&](MyContainer<T> &c) { removed += c.try_remove(value); });
+            return removed;
+        }
+
+        size_t size() const {
+            size_t n = 0;
+            for (const auto &s: shards) {
+                std::lock_guard guard(s->lock);
+                n += s->elements.size();
+            }
+            return n;
+        }
+
+        /* Search */
+
+        bool contains(const T &value) const { return count(value) > 0; }
+
+        size_t count(const T &value) const {
+            size_t n = 0;
+            for_candidates(value, [&](const MyContainer<T> &c) { n += c.count(value); });
+            return n;
+        }
+
+        /* Parallelism (applies to the shards as well) */
+
+        const Parallelism &get_parallelism() const { return parallelism; }
+
+        void set_parallelism(const Parallelism &p) {
+            parallelism = p;
+            for (const auto &s: shards) {
+                std::lock_guard guard(s->lock);
+                s->elements.set_parallelism(p);
+            }
+        }
+
+        friend std::ostream &operator<<(std::ostream &os, const ShardedContainer &c) {
+            for (const auto &v: c.runs(false)->views)
+                for (const auto &item: *v) os << item << " ";
+            return os;
+        }
+
+        /* Iterators (each shard is captured as of the moment the iterator is built)
+
+           Sorted walks merge the shards lazily, so ++ costs O(log shards). Going back (--) or reading at an
+           offset ([] with i != 0) seeks instead, with binary searches over every shard. */
+
+    private:
+        class Iterator {
+        protected:
+            std::shared_ptr<const Runs> runs;
+            Walk walk = Walk::Forward;
+            bool sorted = false;
+            size_t pos = 0;
+            Cursor low, high; // sorted walks: low climbs from the smallest (or the middle), high descends
+            const T *current = nullptr;
+
+            Cursor &source() { return walk == Walk::Forward || (walk != Walk::Backward && pos % 2 == 0) ? low : high; }
+
+            // element i of the shards one after another
+            const T &unsorted(const size_t i) const {
+                const size_t s = std::upper_bound(runs->offsets.begin(), runs->offsets.end(), i) -
+                                 runs->offsets.begin() - 1;
+                return (*runs->views[s])[i - runs->offsets[s]];
+            }
+
+            // element of the given rank in the merged order: the least head once every shard is split there
+            const T &ranked(const size_t rank) const {
+                const auto at = split(*runs, rank);
+                const T *least = nullptr;
+                for (size_t s = 0; s < at.size(); ++s) {
+                    if (at[s] == runs->views[s]->size()) continue;
+                    const T &x = (*runs->views[s])[at[s]];
+                    if (!least || x < *least) least = &x;
+                }
+                return *least;
+            }
+
+            void settle() {
+                const size_t n = size();
+                if (pos >= n) current = nullptr;
+                else if (sorted) current = &source().top();
+                else current = &unsorted(walk_index(walk, pos, n));
+            }
+
+            // moves to position p (< size), setting the cursors up as if every position before it had been walked
+            void seek(const size_t p) {
+                pos = p;
+                if (sorted) {
+                    const size_t n = size();
+                    const auto &r = *runs;
+                    // ranks the cursors read next: low climbs from `up`, high descends from below `down`
+                    size_t up = 0, down = n;
+                    switch (walk) {
+                        case Walk::Forward: up = p;
+                            break;
+                        case Walk::Backward: down = n - p;
+                            break;
+                        case Walk::SideCross: up = (p + 1) / 2;
+                            down = n - p / 2;
+                            break;
+                        case Walk::MiddleOut: up = n / 2 + (p + 1) / 2;
+                            down = n / 2 - p / 2;
+                            break;
+                    }
+                    const auto at = [&](const size_t rank) {
+                        if (rank == 0) return std::vector<size_t>(r.views.size());
+                        if (rank < n) return split(r, rank);
+                        std::vector<size_t> ends;
+                        for (const auto &v: r.views) ends.push_back(v->size());
+                        return ends;
+                    };
+                    low = Cursor(r, at(up), true);
+                    high = Cursor(r, at(down), false);
+                }
+                settle();
+            }
+
+        public:
+            Iterator(std::shared_ptr<const Runs> runs, const Walk walk, const bool sorted, const bool at_end)
+                : runs(std::move(runs)), walk(walk), sorted(sorted) { at_end ? end() : begin(); }
+
+            virtual ~Iterator() = default;
+
+            Iterator &begin() {
+                seek(0);
+                return *this;
+            }
+
+            Iterator &end() {
+                pos = size();
+                current = nullptr;
+                return *this;
+            }
+
+            size_t size() const { return runs->size(); }
+
+            explicit operator bool() const { return current != nullptr; }
+            explicit operator int() const { return static_cast<int>(pos); }
+
+            const T &operator*() const {
+                if (!current) throw std::out_of_range("Iterator out of range");
+                return *current;
+            }
+
+            const T &operator[](const int i) const {
+                if (i == 0) return **this;
+                const auto index = static_cast<long long>(pos) + i;
+                if (index < 0 || static_cast<size_t>(index) >= size()) throw std::out_of_range("Iterator out of range");
+                const size_t at = walk_index(walk, index, size());
+                return sorted ? ranked(at) : unsorted(at);
+            }
+
+            auto &operator++() {
+                if (current) {
+                    if (sorted) source().pop();
+                    ++pos;
+                    settle();
+                }
+                return *this;
+            }
+
+            auto operator++(int) {
+                Iterator tmp = *this;
+                ++*this;
+                return tmp;
+            }
+
+            // stays at the first position
+            auto &operator--() {
+                if (pos > 0) seek(pos - 1);
+                return *this;
+            }
+
+            auto operator--(int) {
+                Iterator tmp = *this;
+                --*this;
+                return tmp;
+            }
+
+            bool operator==(const Iterator &other) const {
+                return pos == other.pos && walk == other.walk && sorted == other.sorted &&
+                       (runs == other.runs || *runs == *other.runs);
+            }
+
+            /* Batches (as for MyContainer's orders, always gathered) */
+
+            size_t next_batch(std::span<T> out) {
+                size_t k = 0;
+                for (; k < out.size() && current; ++*this) out[k++] = *current;
+                return k;
+            }
+
+            template<typename F>
+            void for_each_batch(F &&fn, const size_t batch = 1024) {
+                std::vector<T> buffer(std::min(std::max<size_t>(batch, 1), size()));
+                while (const size_t k = next_batch(buffer)) fn(std::span<const T>(buffer.data(), k));
+            }
+        };
+
+    public:
+        class Order : public Iterator {
+        public:
+            explicit Order(const ShardedContainer &c, const bool at_end = false)
+                : Iterator(c.runs(false), Walk::Forward, false, at_end) {}
+        };
+
+        class ReverseOrder : public Iterator {
+        public:
+            explicit ReverseOrder(const ShardedContainer &c, const bool at_end = false)
+                : Iterator(c.runs(false), Walk::Backward, false, at_end) {}
+        };
+
+        class AscendingOrder : public Iterator {
+        public:
+            explicit AscendingOrder(const ShardedContainer &c, const bool at_end = false)
+                : Iterator(c.runs(true), Walk::Forward, true, at_end) {}
+        };
+
+        class DescendingOrder : public Iterator {
+        public:
+            explicit DescendingOrder(const ShardedContainer &c, const bool at_end = false)
+                : Iterator(c.runs(true), Walk::Backward, true, at_end) {}
+        };
+
+        class SideCrossOrder : public Iterator {
+        public:
+            explicit SideCrossOrder(const ShardedContainer &c, const bool at_end = false)
+                : Iterator(c.runs(true), Walk::SideCross, true, at_end) {}
+        };
+
+        class MiddleOutOrder : public Iterator {
+        public:
+            explicit MiddleOutOrder(const ShardedContainer &c, const bool at_end = false)
+                : Iterator(c.runs(true), Walk::MiddleOut, true, at_end) {}
+        };
+
+        Order begin_order() const { return Order(*this); }
+
+        Order end_order() const { return Order(*this, true); }
+
+        ReverseOrder begin_reverse_order() const { return ReverseOrder(*this); }
+
+        ReverseOrder end_reverse_order() const { return ReverseOrder(*this, true); }
+
+        AscendingOrder begin_ascending_order() const { return AscendingOrder(*this); }
+
+        AscendingOrder end_ascending_order() const { return AscendingOrder(*this, true); }
+
+        DescendingOrder begin_descending_order() const { return DescendingOrder(*this); }
+
+        DescendingOrder end_descending_order() const { return DescendingOrder(*this, true); }
+
+        SideCrossOrder begin_side_cross_order() const { return SideCrossOrder(*this); }
+
+        SideCrossOrder end_side_cross_order() const { return SideCrossOrder(*this, true); }
+
+        MiddleOutOrder begin_middle_out_order() const { return MiddleOutOrder(*this); }
+
+        MiddleOutOrder end_middle_out_order() const { return MiddleOutOrder(*this, true); }
+    };
+} // namespace containers
+
+#endif //SHARDED_HPP
@@ -0,0 +1,1055 @@
+#include "simd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CONTAINERS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace containers::simd {
+    /* Instruction set selection */
+
+    namespace {
+        Level probe() {
+#ifdef CONTAINERS_X86
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                __builtin_cpu_supports("avx512vl"))
+                return Level::AVX512;
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi2")) return Level::AVX2;
+#endif
+            return Level::Scalar;
+        }
+
+        // byte compress (VBMI2) is not part of every AVX-512 CPU; without it byte kernels stay on AVX2
+        bool has_byte_compress() {
+#ifdef CONTAINERS_X86
+            static const bool vbmi2 = __builtin_cpu_supports("avx512vbmi2");
+            return vbmi2;
+#else
+            return false;
+#endif
+        }
+
+        std::atomic cap{Level::AVX512};
+    }
+
+    Level detected() {
+        static const Level l = probe();
+        return l;
+    }
+
+    Level level() { return std::min(detected(), cap.load(std::memory_order_relaxed)); }
+
+    void set_level(const Level cap_) { cap.store(cap_, std::memory_order_relaxed); }
+
+    /* Kernels */
+
+    namespace {
+        // Partitions a[0, n) around pivot: keys below it (or not above it, when inclusive) are compacted
+        // to the front in place, the rest are staged in scratch (n + 64 slots) and copied back after them.
+        // Returns the size of the left part.
+        template<typename T>
+        using Partition = size_t (*)(T *a, size_t n, T pivot, bool inclusive, T *scratch);
+
+        template<typename T>
+        size_t partition_scalar_tail(T *a, size_t n, size_t i, size_t l, size_t r, const T pivot,
+                                     const bool inclusive, T *scratch) {
+            for (; i < n; ++i) {
+                if (inclusive ? !(pivot < a[i]) : a[i] < pivot) a[l++] = a[i];
+                else scratch[r++] = a[i];
+            }
+            std::copy(scratch, scratch + r, a + l);
+            return l;
+        }
+
+        template<typename T>
+        size_t find_scalar(const T *a, const size_t n, const T value) { return std::find(a, a + n, value) - a; }
+
+        // delimiter bits of a[0, n), n <= 64, with the bits from n on set
+        uint64_t delimiter_word(const char *a, const size_t n) {
+            uint64_t word = n < 64 ? ~uint64_t{0} << n : 0;
+            for (size_t i = 0; i < n; ++i) word |= uint64_t{static_cast<unsigned char>(a[i]) <= ' '} << i;
+            return word;
+        }
+
+        void delimiter_mask_scalar(const char *a, const size_t n, uint64_t *masks) {
+            for (size_t i = 0; i < n; i += 64) masks[i / 64] = delimiter_word(a + i, std::min<size_t>(64, n - i));
+        }
+
+        void unpack_scalar(const uint32_t *in, const unsigned width, const int base, int *out) {
+            const uint32_t mask = width == 32 ? ~uint32_t{0} : (uint32_t{1} << width) - 1;
+            for (size_t i = 0; i < pack_block; ++i) {
+                const size_t lane = i % 8, pos = i / 8 * width, word = pos / 32, off = pos % 32;
+                uint32_t v = width ? in[word * 8 + lane] >> off : 0;
+                if (off + width > 32) v |= in[(word + 1) * 8 + lane] << (32 - off);
+                out[i] = static_cast<int>(static_cast<uint32_t>(base) + (v & mask));
+            }
+        }
+
+        template<typename T>
+        size_t count_scalar(const T *a, const size_t n, const T value) { return std::count(a, a + n, value); }
+
+        template<typename T>
+        size_t remove_scalar_tail(T *a, const size_t n, size_t i, size_t w, const T value) {
+            for (; i < n; ++i)
+                if (!(a[i] == value)) a[w++] = a[i];
+            return w;
+        }
+
+        template<typename T>
+        size_t remove_scalar(T *a, const size_t n, const T value) { return remove_scalar_tail(a, n, 0, 0, value); }
+
+        template<typename T>
+        void minmax_scalar(const T *a, const size_t n, T &lo, T &hi) {
+            const auto [l, h] = std::minmax_element(a, a + n);
+            lo = *l;
+            hi = *h;
+        }
+
+        // folds per-lane minima and maxima together with a scalar tail
+        template<typename T>
+        void minmax_scalar(const T *a, const size_t n, const T *l, const T *h, const size_t lanes, T &lo, T &hi) {
+            lo = *std::min_element(l, l + lanes);
+            hi = *std::max_element(h, h + lanes);
+            for (size_t i = 0; i < n; ++i) {
+                lo = std::min(lo, a[i]);
+                hi = std::max(hi, a[i]);
+            }
+        }
+
+        template<typename T>
+        long long sum_scalar(const T *a, const size_t n) {
+            long long s = 0;
+            for (size_t i = 0; i < n; ++i) s += a[i];
+            return s;
+        }
+
+        struct Kahan {
+            double sum = 0, c = 0;
+
+            void add(const double x) {
+                const double y = x - c, t = sum + y;
+                c = t - sum - y;
+                sum = t;
+            }
+        };
+
+        // adds up vector lanes (sums and their compensations) and a scalar tail, in a fixed order
+        template<bool Squared, typename T>
+        double fold_lanes(const double *s, const double *cs, const size_t lanes, const T *a, const size_t n,
+                          const double mean) {
+            Kahan k;
+            for (size_t l = 0; l < lanes; ++l) {
+                k.add(s[l]);
+                k.add(-cs[l]);
+            }
+            for (size_t i = 0; i < n; ++i) {
+                const double x = a[i];
+                k.add(Squared ? (x - mean) * (x - mean) : x);
+            }
+            return k.sum;
+        }
+
+        template<typename T>
+        double squared_deviations_scalar(const T *a, const size_t n, const double mean) {
+            return fold_lanes<true>(nullptr, nullptr, 0, a, n, mean);
+        }
+
+        double sum_scalar_f64(const double *a, const size_t n) { return fold_lanes<false>(nullptr, nullptr, 0, a, n, 0); }
+
+        // search kernels of one key type at one level
+        template<typename T>
+        struct Scan {
+            size_t (*find)(const T *, size_t, T);
+            size_t (*count)(const T *, size_t, T);
+            size_t (*remove)(T *, size_t, T);
+        };
+
+        template<typename T>
+        constexpr Scan<T> scalar_scan{find_scalar<T>, count_scalar<T>, remove_scalar<T>};
+
+#ifdef CONTAINERS_X86
+        // lane permutations that move the lanes selected by a mask to the front, one index per byte
+        constexpr std::array<uint64_t, 256> compress_lut_32() {
+            std::array<uint64_t, 256> lut{};
+            for (unsigned m = 0; m < 256; ++m)
+                for (unsigned i = 0, k = 0; i < 8; ++i)
+                    if (m >> i & 1) lut[m] |= static_cast<uint64_t>(i) << 8 * k++;
+            return lut;
+        }
+
+        // same, for 4 lanes of 64 bits expressed as pairs of 32-bit lanes
+        constexpr std::array<uint64_t, 16> compress_lut_64() {
+            std::array<uint64_t, 16> lut{};
+            for (unsigned m = 0; m < 16; ++m)
+                for (unsigned i = 0, k = 0; i < 4; ++i)
+                    if (m >> i & 1) {
+                        lut[m] |= static_cast<uint64_t>(2 * i) << 8 * k++;
+                        lut[m] |= static_cast<uint64_t>(2 * i + 1) << 8 * k++;
+                    }
+            return lut;
+        }
+
+        constexpr auto lut_32 = compress_lut_32();
+        constexpr auto lut_64 = compress_lut_64();
+
+#pragma GCC push_options
+#pragma GCC target("avx2,bmi2,popcnt")
+        namespace avx2 {
+            __m256i lut_indices(const uint64_t packed) { return _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(packed)); }
+
+            struct I32 {
+                using T = int;
+                using V = __m256i;
+                using M = unsigned;
+                static constexpr size_t lanes = 8;
+                static constexpr M all = 0xFF;
+
+                static V load(const T *p) { return _mm256_loadu_si256(reinterpret_cast<const V *>(p)); }
+                static void store(T *p, const V v) { _mm256_storeu_si256(reinterpret_cast<V *>(p), v); }
+                static V set1(const T x) { return _mm256_set1_epi32(x); }
+
+                static unsigned less(const V v, const V p, const bool inclusive) {
+                    const auto gt = _mm256_castsi256_ps(_mm256_cmpgt_epi32(inclusive ? v : p, inclusive ? p : v));
+                    const unsigned m = _mm256_movemask_ps(gt);
+                    return inclusive ? ~m & all : m;
+                }
+
+                static M equal(const V v, const V p) {
+                    return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, p)));
+                }
+
+                static V min(const V a, const V b) { return _mm256_min_epi32(a, b); }
+                static V max(const V a, const V b) { return _mm256_max_epi32(a, b); }
+
+                static V compress(const V v, const unsigned m) {
+                    return _mm256_permutevar8x32_epi32(v, lut_indices(lut_32[m]));
+                }
+            };
+
+            struct F32 {
+                using T = float;
+                using V = __m256;
+                using M = unsigned;
+                static constexpr size_t lanes = 8;
+                static constexpr M all = 0xFF;
+
+                static V load(const T *p) { return _mm256_loadu_ps(p); }
+                static void store(T *p, const V v) { _mm256_storeu_ps(p, v); }
+                static V set1(const T x) { return _mm256_set1_ps(x); }
+
+                static unsigned less(const V v, const V p, const bool inclusive) {
+                    return _mm256_movemask_ps(inclusive ? _mm256_cmp_ps(v, p, _CMP_LE_OQ)
+                                                        : _mm256_cmp_ps(v, p, _CMP_LT_OQ));
+                }
+
+                static M equal(const V v, const V p) { return _mm256_movemask_ps(_mm256_cmp_ps(v, p, _CMP_EQ_OQ)); }
+
+                static V compress(const V v, const unsigned m) {
+                    return _mm256_permutevar8x32_ps(v, lut_indices(lut_32[m]));
+                }
+            };
+
+            struct F64 {
+                using T = double;
+                using V = __m256d;
+                using M = unsigned;
+                static constexpr size_t lanes = 4;
+                static constexpr M all = 0xF;
+
+                static V load(const T *p) { return _mm256_loadu_pd(p); }
+                static void store(T *p, const V v) { _mm256_storeu_pd(p, v); }
+                static V set1(const T x) { return _mm256_set1_pd(x); }
+
+                static unsigned less(const V v, const V p, const bool inclusive) {
+                    return _mm256_movemask_pd(inclusive ? _mm256_cmp_pd(v, p, _CMP_LE_OQ)
+                                                        : _mm256_cmp_pd(v, p, _CMP_LT_OQ));
+                }
+
+                static M equal(const V v, const V p) { return _mm256_movemask_pd(_mm256_cmp_pd(v, p, _CMP_EQ_OQ)); }
+
+                static V min(const V a, const V b) { return _mm256_min_pd(a, b); }
+                static V max(const V a, const V b) { return _mm256_max_pd(a, b); }
+
+                static V compress(const V v, const unsigned m) {
+                    const auto ps = _mm256_permutevar8x32_ps(_mm256_castpd_ps(v), lut_indices(lut_64[m]));
+                    return _mm256_castps_pd(ps);
+                }
+            };
+
+            struct C8 {
+                using T = char;
+                using V = __m256i;
+                using M = unsigned;
+                static constexpr size_t lanes = 32;
+
+                static V load(const T *p) { return _mm256_loadu_si256(reinterpret_cast<const V *>(p)); }
+                static void store(T *p, const V v) { _mm256_storeu_si256(reinterpret_cast<V *>(p), v); }
+                static V set1(const T x) { return _mm256_set1_epi8(x); }
+                static M equal(const V v, const V p) { return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, p)); }
+
+                static V min(const V a, const V b) {
+                    return std::is_signed_v<T> ? _mm256_min_epi8(a, b) : _mm256_min_epu8(a, b);
+                }
+
+                static V max(const V a, const V b) {
+                    return std::is_signed_v<T> ? _mm256_max_epi8(a, b) : _mm256_max_epu8(a, b);
+                }
+            };
+
+            template<typename K>
+            size_t find(const typename K::T *a, const size_t n, const typename K::T value) {
+                const auto p = K::set1(value);
+                size_t i = 0;
+                for (; i + K::lanes <= n; i += K::lanes)
+                    if (const typename K::M m = K::equal(K::load(a + i), p)) return i + std::countr_zero(m);
+                return i + find_scalar(a + i, n - i, value);
+            }
+
+            template<typename K>
+            size_t count(const typename K::T *a, const size_t n, const typename K::T value) {
+                const auto p = K::set1(value);
+                size_t i = 0, c = 0;
+                for (; i + K::lanes <= n; i += K::lanes) c += std::popcount(K::equal(K::load(a + i), p));
+                return c + count_scalar(a + i, n - i, value);
+            }
+
+            template<typename K>
+            size_t remove(typename K::T *a, const size_t n, const typename K::T value) {
+                const auto p = K::set1(value);
+                size_t i = 0, w = 0;
+                for (; i + K::lanes <= n; i += K::lanes) {
+                    const auto v = K::load(a + i);
+                    const auto keep = static_cast<typename K::M>(~K::equal(v, p) & K::all);
+                    K::store(a + w, K::compress(v, keep));
+                    w += std::popcount(keep);
+                }
+                return remove_scalar_tail(a, n, i, w, value);
+            }
+
+            template<typename K>
+            size_t partition(typename K::T *a, const size_t n, const typename K::T pivot, const bool inclusive,
+                             typename K::T *scratch) {
+                const auto p = K::set1(pivot);
+                size_t i = 0, l = 0, r = 0;
+                for (; i + K::lanes <= n; i += K::lanes) {
+                    const auto v = K::load(a + i);
+                    const unsigned m = K::less(v, p, inclusive);
+                    const auto count = static_cast<size_t>(std::popcount(m));
+                    K::store(a + l, K::compress(v, m));
+                    K::store(scratch + r, K::compress(v, ~m & K::all));
+                    l += count;
+                    r += K::lanes - count;
+                }
+                return partition_scalar_tail(a, n, i, l, r, pivot, inclusive, scratch);
+            }
+
+            size_t partition_i32(int *a, size_t n, int pivot, bool inclusive, int *scratch) {
+                return partition<I32>(a, n, pivot, inclusive, scratch);
+            }
+
+            size_t partition_f32(float *a, size_t n, float pivot, bool inclusive, float *scratch) {
+                return partition<F32>(a, n, pivot, inclusive, scratch);
+            }
+
+            size_t partition_f64(double *a, size_t n, double pivot, bool inclusive, double *scratch) {
+                return partition<F64>(a, n, pivot, inclusive, scratch);
+            }
+
+            // bytes have no lane permute: each 8-byte group is packed with pext under its keep mask
+            size_t remove_c8(char *a, const size_t n, const char value) {
+                const auto p = C8::set1(value);
+                size_t i = 0, w = 0;
+                for (; i + C8::lanes <= n; i += C8::lanes) {
+                    const auto v = C8::load(a + i);
+                    const unsigned keep = ~C8::equal(v, p);
+                    if (keep == ~0u) {
+                        C8::store(a + w, v);
+                        w += C8::lanes;
+                        continue;
+                    }
+                    for (unsigned g = 0; g < C8::lanes; g += 8) {
+                        const unsigned k = keep >> g & 0xFF;
+                        uint64_t bytes;
+                        std::memcpy(&bytes, a + i + g, 8);
+                        const uint64_t packed = _pext_u64(bytes, _pdep_u64(k, 0x0101010101010101ull) * 0xFF);
+                        std::memcpy(a + w, &packed, 8);
+                        w += std::popcount(k);
+                    }
+                }
+                return remove_scalar_tail(a, n, i, w, value);
+            }
+
+            /* Reductions */
+
+            template<typename K>
+            void minmax(const typename K::T *a, const size_t n, typename K::T &lo, typename K::T &hi) {
+                if (n < K::lanes) {
+                    minmax_scalar(a, n, lo, hi);
+                    return;
+                }
+                auto vlo = K::load(a), vhi = vlo;
+                size_t i = K::lanes;
+                for (; i + K::lanes <= n; i += K::lanes) {
+                    const auto v = K::load(a + i);
+                    vlo = K::min(vlo, v);
+                    vhi = K::max(vhi, v);
+                }
+                typename K::T l[K::lanes], h[K::lanes];
+                K::store(l, vlo);
+                K::store(h, vhi);
+                minmax_scalar(a + i, n - i, l, h, K::lanes, lo, hi);
+            }
+
+            long long sum_i32(const int *a, const size_t n) {
+                auto acc = _mm256_setzero_si256();
+                size_t i = 0;
+                for (; i + I32::lanes <= n; i += I32::lanes) {
+                    const auto v = I32::load(a + i);
+                    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+                    acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+                }
+                long long lanes[4];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+                return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_scalar(a + i, n - i);
+            }
+
+            // byte sums come from psadbw against zero, on bytes biased to unsigned
+            long long sum_c8(const char *a, const size_t n) {
+                const auto bias = _mm256_set1_epi8(std::is_signed_v<char> ? -128 : 0);
+                auto acc = _mm256_setzero_si256();
+                size_t i = 0;
+                for (; i + C8::lanes <= n; i += C8::lanes)
+                    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_xor_si256(C8::load(a + i), bias),
+                                                                _mm256_setzero_si256()));
+                long long lanes[4];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+                const long long unbias = std::is_signed_v<char> ? 128 * static_cast<long long>(i) : 0;
+                return lanes[0] + lanes[1] + lanes[2] + lanes[3] - unbias + sum_scalar(a + i, n - i);
+            }
+
+            __m256d widen(const double *p) { return _mm256_loadu_pd(p); }
+
+            __m256d widen(const int *p) {
+                return _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+            }
+
+            __m256d widen(const char *p) {
+                int32_t bytes;
+                std::memcpy(&bytes, p, 4);
+                return _mm256_cvtepi32_pd(_mm_cvtepi8_epi32(_mm_cvtsi32_si128(bytes)));
+            }
+
+            // Kahan sum of x (or of (x - mean)^2) in 4 lanes, the lanes folded together afterwards
+            template<typename T, bool Squared>
+            double compensated_sum(const T *a, const size_t n, const double mean) {
+                const auto m = _mm256_set1_pd(mean);
+                auto sum = _mm256_setzero_pd(), c = sum;
+                size_t i = 0;
+                for (; i + 4 <= n; i += 4) {
+                    auto x = widen(a + i);
+                    if constexpr (Squared) {
+                        x = _mm256_sub_pd(x, m);
+                        x = _mm256_mul_pd(x, x);
+                    }
+                    const auto y = _mm256_sub_pd(x, c);
+                    const auto t = _mm256_add_pd(sum, y);
+                    c = _mm256_sub_pd(_mm256_sub_pd(t, sum), y);
+                    sum = t;
+                }
+                double s[4], cs[4];
+                _mm256_storeu_pd(s, sum);
+                _mm256_storeu_pd(cs, c);
+                return fold_lanes<Squared>(s, cs, 4, a + i, n - i, mean);
+            }
+
+            void delimiter_mask(const char *a, const size_t n, uint64_t *masks) {
+                const auto space = _mm256_set1_epi8(' ');
+                const auto delimiters = [&](const char *p) -> uint64_t {
+                    const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                    // unsigned v <= ' ' exactly when max(v, ' ') == ' '
+                    const auto m = _mm256_cmpeq_epi8(_mm256_max_epu8(v, space), space);
+                    return static_cast<uint32_t>(_mm256_movemask_epi8(m));
+                };
+                size_t i = 0;
+                for (; i + 64 <= n; i += 64) masks[i / 64] = delimiters(a + i) | delimiters(a + i + 32) << 32;
+                if (i < n) masks[i / 64] = delimiter_word(a + i, n - i);
+            }
+
+            void unpack(const uint32_t *in, const unsigned width, const int base, int *out) {
+                const auto b = _mm256_set1_epi32(base);
+                auto *o = reinterpret_cast<__m256i *>(out);
+                if (!width) {
+                    for (size_t k = 0; k < pack_block / 8; ++k) _mm256_storeu_si256(o + k, b);
+                    return;
+                }
+                const auto mask = _mm256_set1_epi32(static_cast<int>(width == 32 ? ~0u : (1u << width) - 1));
+                const auto *word = reinterpret_cast<const __m256i *>(in);
+                auto current = _mm256_loadu_si256(word);
+                unsigned off = 0;
+                for (size_t k = 0; k < pack_block; k += 8) {
+                    auto v = _mm256_srl_epi32(current, _mm_cvtsi32_si128(static_cast<int>(off)));
+                    off += width;
+                    if (off > 32) {
+                        // the value continues in the low bits of the next word
+                        current = _mm256_loadu_si256(++word);
+                        off -= 32;
+                        const auto up = _mm_cvtsi32_si128(static_cast<int>(width - off));
+                        v = _mm256_or_si256(v, _mm256_sll_epi32(current, up));
+                    } else if (off == 32 && k + 8 < pack_block) {
+                        current = _mm256_loadu_si256(++word);
+                        off = 0;
+                    }
+                    v = _mm256_add_epi32(_mm256_and_si256(v, mask), b);
+                    _mm256_storeu_si256(o + k / 8, v);
+                }
+            }
+        } // namespace avx2
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx512vl,avx512dq,popcnt")
+        namespace avx512 {
+            struct I32 {
+                using T = int;
+                using V = __m512i;
+                using M = __mmask16;
+                static constexpr size_t lanes = 16;
+                static constexpr M all = 0xFFFF;
+
+                static V load(const T *p) { return _mm512_loadu_si512(p); }
+                static void store(T *p, const V v) { _mm512_storeu_si512(p, v); }
+                static V set1(const T x) { return _mm512_set1_epi32(x); }
+
+                static M less(const V v, const V p, const bool inclusive) {
+                    return inclusive ? _mm512_cmple_epi32_mask(v, p) : _mm512_cmplt_epi32_mask(v, p);
+                }
+
+                static M equal(const V v, const V p) { return _mm512_cmpeq_epi32_mask(v, p); }
+
+                static V min(const V a, const V b) { return _mm512_min_epi32(a, b); }
+                static V max(const V a, const V b) { return _mm512_max_epi32(a, b); }
+
+                static V compress(const V v, const M m) { return _mm512_maskz_compress_epi32(m, v); }
+            };
+
+            struct F32 {
+                using T = float;
+                using V = __m512;
+                using M = __mmask16;
+                static constexpr size_t lanes = 16;
+                static constexpr M all = 0xFFFF;
+
+                static V load(const T *p) { return _mm512_loadu_ps(p); }
+                static void store(T *p, const V v) { _mm512_storeu_ps(p, v); }
+                static V set1(const T x) { return _mm512_set1_ps(x); }
+
+                static M less(const V v, const V p, const bool inclusive) {
+                    return inclusive ? _mm512_cmp_ps_mask(v, p, _CMP_LE_OQ) : _mm512_cmp_ps_mask(v, p, _CMP_LT_OQ);
+                }
+
+                static M equal(const V v, const V p) { return _mm512_cmp_ps_mask(v, p, _CMP_EQ_OQ); }
+
+                static V compress(const V v, const M m) { return _mm512_maskz_compress_ps(m, v); }
+            };
+
+            struct F64 {
+                using T = double;
+                using V = __m512d;
+                using M = __mmask8;
+                static constexpr size_t lanes = 8;
+                static constexpr M all = 0xFF;
+
+                static V load(const T *p) { return _mm512_loadu_pd(p); }
+                static void store(T *p, const V v) { _mm512_storeu_pd(p, v); }
+                static V set1(const T x) { return _mm512_set1_pd(x); }
+
+                static M less(const V v, const V p, const bool inclusive) {
+                    return inclusive ? _mm512_cmp_pd_mask(v, p, _CMP_LE_OQ) : _mm512_cmp_pd_mask(v, p, _CMP_LT_OQ);
+                }
+
+                static M equal(const V v, const V p) { return _mm512_cmp_pd_mask(v, p, _CMP_EQ_OQ); }
+
+                static V min(const V a, const V b) { return _mm512_min_pd(a, b); }
+                static V max(const V a, const V b) { return _mm512_max_pd(a, b); }
+
+                static V compress(const V v, const M m) { return _mm512_maskz_compress_pd(m, v); }
+            };
+
+            struct C8 {
+                using T = char;
+                using V = __m512i;
+                using M = __mmask64;
+                static constexpr size_t lanes = 64;
+                static constexpr M all = ~0ull;
+
+                static V load(const T *p) { return _mm512_loadu_si512(p); }
+                static void store(T *p, const V v) { _mm512_storeu_si512(p, v); }
+                static V set1(const T x) { return _mm512_set1_epi8(x); }
+                static M equal(const V v, const V p) { return _mm512_cmpeq_epi8_mask(v, p); }
+
+                static V min(const V a, const V b) {
+                    return std::is_signed_v<T> ? _mm512_min_epi8(a, b) : _mm512_min_epu8(a, b);
+                }
+
+                static V max(const V a, const V b) {
+                    return std::is_signed_v<T> ? _mm512_max_epi8(a, b) : _mm512_max_epu8(a, b);
+                }
+            };
+
+            template<typename K>
+            size_t find(const typename K::T *a, const size_t n, const typename K::T value) {
+                const auto p = K::set1(value);
+                size_t i = 0;
+                for (; i + K::lanes <= n; i += K::lanes)
+                    if (const typename K::M m = K::equal(K::load(a + i), p)) return i + std::countr_zero(m);
+                return i + find_scalar(a + i, n - i, value);
+            }
+
+            template<typename K>
+            size_t count(const typename K::T *a, const size_t n, const typename K::T value) {
+                const auto p = K::set1(value);
+                size_t i = 0, c = 0;
+                for (; i + K::lanes <= n; i += K::lanes) c += std::popcount(K::equal(K::load(a + i), p));
+                return c + count_scalar(a + i, n - i, value);
+            }
+
+            template<typename K>
+            size_t remove(typename K::T *a, const size_t n, const typename K::T value) {
+                const auto p = K::set1(value);
+                size_t i = 0, w = 0;
+                for (; i + K::lanes <= n; i += K::lanes) {
+                    const auto v = K::load(a + i);
+                    const auto keep = static_cast<typename K::M>(~K::equal(v, p) & K::all);
+                    K::store(a + w, K::compress(v, keep));
+                    w += std::popcount(keep);
+                }
+                return remove_scalar_tail(a, n, i, w, value);
+            }
+
+            template<typename K>
+            size_t partition(typename K::T *a, const size_t n, const typename K::T pivot, const bool inclusive,
+                             typename K::T *scratch) {
+                const auto p = K::set1(pivot);
+                size_t i = 0, l = 0, r = 0;
+                for (; i + K::lanes <= n; i += K::lanes) {
+                    const auto v = K::load(a + i);
+                    const typename K::M m = K::less(v, p, inclusive);
+                    const auto count = static_cast<size_t>(std::popcount(static_cast<unsigned>(m)));
+                    K::store(a + l, K::compress(v, m));
+                    K::store(scratch + r, K::compress(v, static_cast<typename K::M>(~m)));
+                    l += count;
+                    r += K::lanes - count;
+                }
+                return partition_scalar_tail(a, n, i, l, r, pivot, inclusive, scratch);
+            }
+
+            size_t partition_i32(int *a, size_t n, int pivot, bool inclusive, int *scratch) {
+                return partition<I32>(a, n, pivot, inclusive, scratch);
+            }
+
+            size_t partition_f32(float *a, size_t n, float pivot, bool inclusive, float *scratch) {
+                return partition<F32>(a, n, pivot, inclusive, scratch);
+            }
+
+            size_t partition_f64(double *a, size_t n, double pivot, bool inclusive, double *scratch) {
+                return partition<F64>(a, n, pivot, inclusive, scratch);
+            }
+
+            /* Reductions */
+
+            template<typename K>
+            void minmax(const typename K::T *a, const size_t n, typename K::T &lo, typename K::T &hi) {
+                if (n < K::lanes) {
+                    minmax_scalar(a, n, lo, hi);
+                    return;
+                }
+                auto vlo = K::load(a), vhi = vlo;
+                size_t i = K::lanes;
+                for (; i + K::lanes <= n; i += K::lanes) {
+                    const auto v = K::load(a + i);
+                    vlo = K::min(vlo, v);
+                    vhi = K::max(vhi, v);
+                }
+                typename K::T l[K::lanes], h[K::lanes];
+                K::store(l, vlo);
+                K::store(h, vhi);
+                minmax_scalar(a + i, n - i, l, h, K::lanes, lo, hi);
+            }
+
+            long long sum_i32(const int *a, const size_t n) {
+                auto acc = _mm512_setzero_si512();
+                size_t i = 0;
+                for (; i + I32::lanes <= n; i += I32::lanes) {
+                    const auto v = I32::load(a + i);
+                    acc = _mm512_add_epi64(acc, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(v)));
+                    acc = _mm512_add_epi64(acc, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+                }
+                return _mm512_reduce_add_epi64(acc) + sum_scalar(a + i, n - i);
+            }
+
+            long long sum_c8(const char *a, const size_t n) {
+                const auto bias = _mm512_set1_epi8(std::is_signed_v<char> ? -128 : 0);
+                auto acc = _mm512_setzero_si512();
+                size_t i = 0;
+                for (; i + C8::lanes <= n; i += C8::lanes)
+                    acc = _mm512_add_epi64(acc, _mm512_sad_epu8(_mm512_xor_si512(C8::load(a + i), bias),
+                                                                _mm512_setzero_si512()));
+                const long long unbias = std::is_signed_v<char> ? 128 * static_cast<long long>(i) : 0;
+                return _mm512_reduce_add_epi64(acc) - unbias + sum_scalar(a + i, n - i);
+            }
+
+            __m512d widen(const double *p) { return _mm512_loadu_pd(p); }
+
+            __m512d widen(const int *p) {
+                return _mm512_cvtepi32_pd(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+            }
+
+            __m512d widen(const char *p) {
+                return _mm512_cvtepi32_pd(_mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))));
+            }
+
+            template<typename T, bool Squared>
+            double compensated_sum(const T *a, const size_t n, const double mean) {
+                const auto m = _mm512_set1_pd(mean);
+                auto sum = _mm512_setzero_pd(), c = sum;
+                size_t i = 0;
+                for (; i + 8 <= n; i += 8) {
+                    auto x = widen(a + i);
+                    if constexpr (Squared) {
+                        x = _mm512_sub_pd(x, m);
+                        x = _mm512_mul_pd(x, x);
+                    }
+                    const auto y = _mm512_sub_pd(x, c);
+                    const auto t = _mm512_add_pd(sum, y);
+                    c = _mm512_sub_pd(_mm512_sub_pd(t, sum), y);
+                    sum = t;
+                }
+                double s[8], cs[8];
+                _mm512_storeu_pd(s, sum);
+                _mm512_storeu_pd(cs, c);
+                return fold_lanes<Squared>(s, cs, 8, a + i, n - i, mean);
+            }
+
+            void delimiter_mask(const char *a, const size_t n, uint64_t *masks) {
+                const auto space = _mm512_set1_epi8(' ');
+                size_t i = 0;
+                for (; i + 64 <= n; i += 64) masks[i / 64] = _mm512_cmple_epu8_mask(_mm512_loadu_si512(a + i), space);
+                if (i < n) masks[i / 64] = delimiter_word(a + i, n - i);
+            }
+        } // namespace avx512
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx512vbmi2,popcnt")
+        namespace avx512 {
+            size_t remove_c8(char *a, const size_t n, const char value) {
+                const auto p = C8::set1(value);
+                size_t i = 0, w = 0;
+                for (; i + C8::lanes <= n; i += C8::lanes) {
+                    const auto v = C8::load(a + i);
+                    const C8::M keep = ~C8::equal(v, p);
+                    C8::store(a + w, _mm512_maskz_compress_epi8(keep, v));
+                    w += std::popcount(keep);
+                }
+                return remove_scalar_tail(a, n, i, w, value);
+            }
+        } // namespace avx512
+#pragma GCC pop_options
+#endif
+
+        /* Vectorized quicksort */
+
+        constexpr size_t small_sort = 24;
+
+        template<typename T>
+        void insertion_sort(T *a, const size_t n) {
+            for (size_t i = 1; i < n; ++i) {
+                const T x = a[i];
+                size_t j = i;
+                for (; j > 0 && x < a[j - 1]; --j) a[j] = a[j - 1];
+                a[j] = x;
+            }
+        }
+
+        template<typename T>
+        T median_of_3(const T a, const T b, const T c) {
+            if (a < b) return b < c ? b : a < c ? c : a;
+            return a < c ? a : b < c ? c : b;
+        }
+
+        template<typename T>
+        T choose_pivot(const T *a, const size_t n) {
+            if (n < 128) return median_of_3(a[0], a[n / 2], a[n - 1]);
+            const size_t s = n / 8;
+            return median_of_3(median_of_3(a[0], a[s], a[2 * s]),
+                               median_of_3(a[3 * s], a[n / 2], a[5 * s]),
+                               median_of_3(a[6 * s], a[7 * s], a[n - 1]));
+        }
+
+        template<typename T>
+        void quicksort(T *a, size_t n, T *scratch, int depth, const Partition<T> partition) {
+            while (n > small_sort) {
+                if (depth-- == 0) {
+                    std::sort(a, a + n);
+                    return;
+                }
+                const T pivot = choose_pivot(a, n);
+                size_t m = partition(a, n, pivot, false, scratch);
+                if (m == 0) {
+                    // the pivot is the minimum: split off its run of equal keys, which is already in place
+                    m = partition(a, n, pivot, true, scratch);
+                    if (m == 0) {
+                        // unordered keys (NaN pivot)
+                        std::sort(a, a + n);
+                        return;
+                    }
+                    a += m;
+                    n -= m;
+                    continue;
+                }
+                // recurse into the smaller side, loop on the larger one
+                if (m < n - m) {
+                    quicksort(a, m, scratch, depth, partition);
+                    a += m;
+                    n -= m;
+                } else {
+                    quicksort(a + m, n - m, scratch, depth, partition);
+                    n = m;
+                }
+            }
+            insertion_sort(a, n);
+        }
+
+        template<typename T>
+        void sort_dispatch(T *a, const size_t n, const Partition<T> avx2_partition,
+                           const Partition<T> avx512_partition) {
+            const Level l = level();
+            if (l == Level::Scalar || n <= small_sort) {
+                std::sort(a, a + n);
+                return;
+            }
+            const auto scratch = std::make_unique_for_overwrite<T[]>(n + 64);
+            const auto partition = l == Level::AVX512 ? avx512_partition : avx2_partition;
+            quicksort(a, n, scratch.get(), 2 * static_cast<int>(std::bit_width(n)), partition);
+        }
+    }
+
+    /* Sort */
+
+#ifdef CONTAINERS_X86
+    void sort(int *first, const size_t n) { sort_dispatch(first, n, avx2::partition_i32, avx512::partition_i32); }
+
+    void sort(float *first, const size_t n) { sort_dispatch(first, n, avx2::partition_f32, avx512::partition_f32); }
+
+    void sort(double *first, const size_t n) { sort_dispatch(first, n, avx2::partition_f64, avx512::partition_f64); }
+#else
+    void sort(int *first, const size_t n) { std::sort(first, first + n); }
+
+    void sort(float *first, const size_t n) { std::sort(first, first + n); }
+
+    void sort(double *first, const size_t n) { std::sort(first, first + n); }
+#endif
+
+    /* Search */
+
+    namespace {
+        template<typename T>
+        Scan<T> scan();
+
+#ifdef CONTAINERS_X86
+        template<typename T, typename AVX2, typename AVX512>
+        Scan<T> scan_at_level() {
+            switch (level()) {
+                case Level::AVX512: return {avx512::find<AVX512>, avx512::count<AVX512>, avx512::remove<AVX512>};
+                case Level::AVX2: return {avx2::find<AVX2>, avx2::count<AVX2>, avx2::remove<AVX2>};
+                default: return scalar_scan<T>;
+            }
+        }
+
+        template<>
+        Scan<int> scan() { return scan_at_level<int, avx2::I32, avx512::I32>(); }
+
+        template<>
+        Scan<double> scan() { return scan_at_level<double, avx2::F64, avx512::F64>(); }
+
+        template<>
+        Scan<char> scan() {
+            switch (level()) {
+                case Level::AVX512:
+                    return {avx512::find<avx512::C8>, avx512::count<avx512::C8>,
+                            has_byte_compress() ? avx512::remove_c8 : avx2::remove_c8};
+                case Level::AVX2: return {avx2::find<avx2::C8>, avx2::count<avx2::C8>, avx2::remove_c8};
+                default: return scalar_scan<char>;
+            }
+        }
+#else
+        template<typename T>
+        Scan<T> scan() { return scalar_scan<T>; }
+#endif
+    }
+
+    size_t find(const int *first, const size_t n, const int value) { return scan<int>().find(first, n, value); }
+
+    size_t find(const double *first, const size_t n, const double value) {
+        return scan<double>().find(first, n, value);
+    }
+
+    size_t find(const char *first, const size_t n, const char value) { return scan<char>().find(first, n, value); }
+
+    size_t count(const int *first, const size_t n, const int value) { return scan<int>().count(first, n, value); }
+
+    size_t count(const double *first, const size_t n, const double value) {
+        return scan<double>().count(first, n, value);
+    }
+
+    size_t count(const char *first, const size_t n, const char value) {
+        return scan<char>().count(first, n, value);
+    }
+
+    size_t remove(int *first, const size_t n, const int value) { return scan<int>().remove(first, n, value); }
+
+    size_t remove(double *first, const size_t n, const double value) {
+        return scan<double>().remove(first, n, value);
+    }
+
+    size_t remove(char *first, const size_t n, const char value) { return scan<char>().remove(first, n, value); }
+
+    /* Reductions */
+
+    namespace {
+        template<typename T, typename S>
+        struct Reduce {
+            void (*minmax)(const T *, size_t, T &, T &);
+            S (*sum)(const T *, size_t);
+            double (*squared_deviations)(const T *, size_t, double);
+        };
+
+        template<typename T, typename S>
+        Reduce<T, S> reduce();
+
+#ifdef CONTAINERS_X86
+        template<>
+        Reduce<int, long long> reduce() {
+            switch (level()) {
+                case Level::AVX512:
+                    return {avx512::minmax<avx512::I32>, avx512::sum_i32, avx512::compensated_sum<int, true>};
+                case Level::AVX2: return {avx2::minmax<avx2::I32>, avx2::sum_i32, avx2::compensated_sum<int, true>};
+                default: return {minmax_scalar<int>, sum_scalar<int>, squared_deviations_scalar<int>};
+            }
+        }
+
+        template<>
+        Reduce<char, long long> reduce() {
+            switch (level()) {
+                case Level::AVX512:
+                    return {avx512::minmax<avx512::C8>, avx512::sum_c8, avx512::compensated_sum<char, true>};
+                case Level::AVX2: return {avx2::minmax<avx2::C8>, avx2::sum_c8, avx2::compensated_sum<char, true>};
+                default: return {minmax_scalar<char>, sum_scalar<char>, squared_deviations_scalar<char>};
+            }
+        }
+
+        template<>
+        Reduce<double, double> reduce() {
+            switch (level()) {
+                case Level::AVX512:
+                    return {avx512::minmax<avx512::F64>, [](const double *a, const size_t n) {
+                        return avx512::compensated_sum<double, false>(a, n, 0);
+                    }, avx512::compensated_sum<double, true>};
+                case Level::AVX2:
+                    return {avx2::minmax<avx2::F64>, [](const double *a, const size_t n) {
+                        return avx2::compensated_sum<double, false>(a, n, 0);
+                    }, avx2::compensated_sum<double, true>};
+                default: return {minmax_scalar<double>, sum_scalar_f64, squared_deviations_scalar<double>};
+            }
+        }
+#else
+        template<>
+        Reduce<int, long long> reduce() {
+            return {minmax_scalar<int>, sum_scalar<int>, squared_deviations_scalar<int>};
+        }
+
+        template<>
+        Reduce<char, long long> reduce() {
+            return {minmax_scalar<char>, sum_scalar<char>, squared_deviations_scalar<char>};
+        }
+
+        template<>
+        Reduce<double, double> reduce() {
+            return {minmax_scalar<double>, sum_scalar_f64, squared_deviations_scalar<double>};
+        }
+#endif
+    }
+
+    void minmax(const int *first, const size_t n, int &min, int &max) {
+        reduce<int, long long>().minmax(first, n, min, max);
+    }
+
+    void minmax(const double *first, const size_t n, double &min, double &max) {
+        reduce<double, double>().minmax(first, n, min, max);
+    }
+
+    void minmax(const char *first, const size_t n, char &min, char &max) {
+        reduce<char, long long>().minmax(first, n, min, max);
+    }
+
+    long long sum(const int *first, const size_t n) { return reduce<int, long long>().sum(first, n); }
+
+    long long sum(const char *first, const size_t n) { return reduce<char, long long>().sum(first, n); }
+
+    double sum(const double *first, const size_t n) { return reduce<double, double>().sum(first, n); }
+
+    double squared_deviations(const int *first, const size_t n, const double mean) {
+        return reduce<int, long long>().squared_deviations(first, n, mean);
+    }
+
+    double squared_deviations(const double *first, const size_t n, const double mean) {
+        return reduce<double, double>().squared_deviations(first, n, mean);
+    }
+
+    double squared_deviations(const char *first, const size_t n, const double mean) {
+        return reduce<char, long long>().squared_deviations(first, n, mean);
+    }
+
+    /* Text scanning */
+
+    void delimiter_mask(const char *first, const size_t n, uint64_t *masks) {
+#ifdef CONTAINERS_X86
+        switch (level()) {
+            case Level::AVX512: return avx512::delimiter_mask(first, n, masks);
+            case Level::AVX2: return avx2::delimiter_mask(first, n, masks);
+            default: break;
+        }
+#endif
+        delimiter_mask_scalar(first, n, masks);
+    }
+
+    /* Bit packing */
+
+    void pack(const int *in, const int base, const unsigned width, uint32_t *out) {
+        std::fill(out, out + packed_words(width), 0);
+        if (!width) return;
+        for (size_t i = 0; i < pack_block; ++i) {
+            const uint32_t v = static_cast<uint32_t>(in[i]) - static_cast<uint32_t>(base);
+            const size_t lane = i % 8, pos = i / 8 * width, word = pos / 32, off = pos % 32;
+            out[word * 8 + lane] |= v << off;
+            if (off + width > 32) out[(word + 1) * 8 + lane] |= v >> (32 - off);
+        }
+    }
+
+    void unpack(const uint32_t *in, const unsigned width, const int base, int *out) {
+#ifdef CONTAINERS_X86
+        if (level() != Level::Scalar) return avx2::unpack(in, width, base, out);
+#endif
+        unpack_scalar(in, width, base, out);
+    }
+} // namespace containers::simd
@@ -0,0 +1,80 @@
+#ifndef SIMD_HPP
+#define SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace containers::simd {
+    /* Instruction set selection */
+
+    enum class Level { Scalar, AVX2, AVX512 };
+
+    // best level supported by both the CPU and the OS
+    Level detected();
+
+    // level the kernels currently run at: detected(), capped by set_level()
+    Level level();
+
+    // caps the level used by the kernels (mostly for tests and benchmarks)
+    void set_level(Level cap);
+
+    /* Sort (ascending, in place) */
+
+    void sort(int *first, size_t n);
+    void sort(float *first, size_t n);
+    void sort(double *first, size_t n);
+
+    /* Search (equality as in operator==) */
+
+    // index of the first element equal to value, n if there is none
+    size_t find(const int *first, size_t n, int value);
+    size_t find(const double *first, size_t n, double value);
+    size_t find(const char *first, size_t n, char value);
+
+    size_t count(const int *first, size_t n, int value);
+    size_t count(const double *first, size_t n, double value);
+    size_t count(const char *first, size_t n, char value);
+
+    // drops every element equal to value, compacting the others to the front in order; returns how many remain
+    size_t remove(int *first, size_t n, int value);
+    size_t remove(double *first, size_t n, double value);
+    size_t remove(char *first, size_t n, char value);
+
+    /* Reductions */
+
+    // smallest and largest element of a non-empty range
+    void minmax(const int *first, size_t n, int &min, int &max);
+    void minmax(const double *first, size_t n, double &min, double &max);
+    void minmax(const char *first, size_t n, char &min, char &max);
+
+    long long sum(const int *first, size_t n);
+    long long sum(const char *first, size_t n);
+    double sum(const double *first, size_t n); // Kahan-compensated
+
+    // Kahan-compensated sum of (x - mean)^2
+    double squared_deviations(const int *first, size_t n, double mean);
+    double squared_deviations(const double *first, size_t n, double mean);
+    double squared_deviations(const char *first, size_t n, double mean);
+
+    /* Text scanning */
+
+    // Sets bit i % 64 of masks[i / 64] when first[i] is a delimiter: a byte up to ' ' (space, tab, newline and
+    // the other control characters). The bits past n in the last word are set as well.
+    void delimiter_mask(const char *first, size_t n, uint64_t *masks);
+
+    /* Bit packing (frame of reference, blocks of 128 ints) */
+
+    constexpr size_t pack_block = 128;
+
+    // A block is stored as offsets from a base, each in `width` bits (0 to 32). Value i goes to lane i % 8;
+    // each lane packs its 16 values into consecutive words, and word j of every lane is stored as the 8 words
+    // [8j, 8j + 8), so that eight values unpack per AVX2 instruction.
+    constexpr size_t packed_words(const unsigned width) { return 8 * ((width + 1) / 2); }
+
+    // packs in[0, 128) into packed_words(width) words; every in[i] - base must fit in width bits
+    void pack(const int *in, int base, unsigned width, uint32_t *out);
+
+    void unpack(const uint32_t *in, unsigned width, int base, int *out);
+} // namespace containers::simd
+
+#endif //SIMD_HPP
@@ -0,0 +1,29 @@
+#include "text.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <locale>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace containers::detail {
+    std::optional<int> plain_precision(const std::ostream &os) {
+        constexpr auto differs = std::ios_base::showbase | std::ios_base::showpoint | std::ios_base::showpos |
+                                 std::ios_base::uppercase | std::ios_base::floatfield;
+        const auto base = os.flags() & std::ios_base::basefield;
+        if (os.flags() & differs || (base && base != std::ios_base::dec) || os.width() != 0 ||
+            os.getloc() != std::locale::classic())
+            return std::nullopt;
+        return static_cast<int>(os.precision());
+    }
+
+    void write_fd(const int fd, const char *bytes, size_t n) {
+        while (n) {
+            const ssize_t k = ::write(fd, bytes, n);
+            if (k < 0 && errno == EINTR) continue;
+            if (k < 0) throw std::runtime_error(std::string("Cannot write: ") + std::strerror(errno));
+            bytes += k;
+            n -= k;
+        }
+    }
+} // namespace containers::detail
@@ -0,0 +1,181 @@
+#ifndef TEXT_HPP
+#define TEXT_HPP
+
+#include <bit>
+#include <charconv>
+#include <concepts>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "parallel.hpp"
+#include "simd.hpp"
+
+namespace containers::detail {
+    /* Text formatting */
+
+    // element types formatted here exactly as a default-configured std::ostream would print them
+    template<typename T>
+    concept text_formattable =
+            std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view> || std::is_same_v<T, char> ||
+            std::is_floating_point_v<T> ||
+            std::is_same_v<T, short> || std::is_same_v<T, unsigned short> || std::is_same_v<T, int> ||
+            std::is_same_v<T, unsigned> || std::is_same_v<T, long> || std::is_same_v<T, unsigned long> ||
+            std::is_same_v<T, long long> || std::is_same_v<T, unsigned long long>;
+
+    // The precision os formats floating point with, if it prints like a default-configured stream (decimal,
+    // no field width, default float format, classic locale); nullopt if anything would look different.
+    std::optional<int> plain_precision(const std::ostream &os);
+
+    // writes all n bytes to fd, retrying short writes
+    void write_fd(int fd, const char *bytes, size_t n);
+
+    constexpr size_t text_block = 1 << 16; // bytes formatted before they are handed over
+    constexpr size_t text_grain = 1 << 14; // elements per chunk when formatting in parallel
+
+    // appends value and a space, as os << value << " " does
+    template<text_formattable T>
+    void append_text(std::string &out, const T &value, const int precision) {
+        if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) out.append(value);
+        else if constexpr (std::is_same_v<T, char>) out.push_back(value);
+        else {
+            char digits[64];
+            std::to_chars_result r;
+            if constexpr (std::is_floating_point_v<T>)
+                r = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, precision);
+            else r = std::to_chars(digits, digits + sizeof(digits), value);
+            out.append(digits, r.ptr);
+        }
+        out.push_back(' ');
+    }
+
+    // Formats at(0), ..., at(n - 1) and hands the text to sink(const char *, size_t) in blocks of about
+    // text_block bytes. In parallel, waves of chunks are formatted into buffers reused from wave to wave
+    // and handed over in order, so the text is the same either way.
+    template<typename At, typename Sink>
+    void format_text(const size_t n, At &&at, const int precision, const Parallelism &p, Sink &&sink) {
+        if (!p.applies(n)) {
+            thread_local std::string buffer;
+            buffer.clear();
+            for (size_t i = 0; i < n; ++i) {
+                append_text(buffer, at(i), precision);
+                if (buffer.size() >= text_block) {
+                    sink(buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+            }
+            if (!buffer.empty()) sink(buffer.data(), buffer.size());
+            return;
+        }
+        const size_t chunks = (n + text_grain - 1) / text_grain;
+        std::vector<std::string> pieces(std::min(chunks, 4 * p.threads));
+        for (size_t first = 0; first < chunks; first += pieces.size()) {
+            const size_t k = std::min(pieces.size(), chunks - first);
+            parallel_for(k, 1, p.threads, [&](const size_t b, const size_t e) {
+                for (size_t c = b; c < e; ++c) {
+                    auto &piece = pieces[c];
+                    piece.clear();
+                    const size_t lo = (first + c) * text_grain, hi = std::min(n, lo + text_grain);
+                    for (size_t i = lo; i < hi; ++i) append_text(piece, at(i), precision);
+                }
+            });
+            for (size_t c = 0; c < k; ++c) sink(pieces[c].data(), pieces[c].size());
+        }
+    }
+
+    /* Text parsing */
+
+    // the same types read back
+    template<typename T>
+    concept text_parsable = text_formattable<T>;
+
+    // Calls fn(std::string_view) for every token of text in order: a token is a maximal run of bytes other
+    // than delimiters (see simd::delimiter_mask). Delimiters are found 64 bytes at a time and tokens are cut
+    // at the edges between the two kinds of bytes.
+    template<typename F>
+    void for_each_token(const std::string_view text, F &&fn) {
+        constexpr size_t block = 1 << 12;
+        uint64_t masks[block / 64];
+        const char *const data = text.data();
+        const size_t n = text.size();
+        size_t start = 0;
+        bool inside = false; // in a token at the current position
+        for (size_t base = 0; base < n; base += block) {
+            const size_t len = std::min(block, n - base);
+            simd::delimiter_mask(data + base, len, masks);
+            for (size_t w = 0; w * 64 < len; ++w) {
+                const size_t bits = std::min<size_t>(64, len - w * 64);
+                const uint64_t d = masks[w];
+                // bits where a byte differs in kind from the one before it
+                uint64_t edges = (d ^ (d << 1 | uint64_t{!inside})) & (~uint64_t{0} >> (64 - bits));
+                for (; edges; edges &= edges - 1) {
+                    const size_t at = base + w * 64 + std::countr_zero(edges);
+                    if (inside) fn(std::string_view(data + start, at - start));
+                    else start = at;
+                    inside = !inside;
+                }
+            }
+        }
+        if (inside) fn(std::string_view(data + start, n - start));
+    }
+
+    // appends the value(s) a token holds: a char per byte for char, the token for strings (the token itself for
+    // string_views, which point into the text), one number otherwise
+    template<text_parsable T>
+    void parse_token(const std::string_view token, std::vector<T> &out) {
+        if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>) out.emplace_back(token);
+        else if constexpr (std::is_same_v<T, char>) out.insert(out.end(), token.begin(), token.end());
+        else {
+            // from_chars takes no '+', operator>> does
+            const bool plus = token.size() > 1 && token[0] == '+' && token[1] != '-';
+            const char *first = token.data() + plus, *last = token.data() + token.size();
+            T value;
+            const auto [end, error] = std::from_chars(first, last, value);
+            if (error == std::errc::result_out_of_range)
+                throw std::out_of_range("Value out of range: " + std::string(token));
+            if (error != std::errc() || end != last)
+                throw std::runtime_error("Cannot parse \"" + std::string(token) + "\"");
+            out.push_back(value);
+        }
+    }
+
+    // Parses every token of text in order. In parallel the text is cut into pieces at delimiters, parsed
+    // on the pool and joined in order, so the result is the same either way.
+    template<text_parsable T>
+    std::vector<T> parse_text(const std::string_view text, const Parallelism &p) {
+        std::vector<T> out;
+        const auto parse = [](const std::string_view piece, std::vector<T> &values) {
+            values.reserve(values.size() + piece.size() / 8);
+            for_each_token(piece, [&](const std::string_view token) { parse_token(token, values); });
+        };
+        // bytes stand in for elements here
+        if (!p.applies(text.size())) {
+            parse(text, out);
+            return out;
+        }
+        const size_t k = 4 * p.threads;
+        std::vector<size_t> cuts{0};
+        for (size_t i = 1; i < k; ++i) {
+            size_t at = std::max(cuts.back(), text.size() / k * i);
+            while (at < text.size() && static_cast<unsigned char>(text[at]) > ' ') ++at;
+            cuts.push_back(at);
+        }
+        cuts.push_back(text.size());
+        std::vector<std::vector<T>> pieces(k);
+        parallel_for(k, 1, p.threads, [&](const size_t b, const size_t e) {
+            for (size_t i = b; i < e; ++i) parse(text.substr(cuts[i], cuts[i + 1] - cuts[i]), pieces[i]);
+        });
+        size_t total = 0;
+        for (const auto &piece: pieces) total += piece.size();
+        out.reserve(total);
+        for (auto &piece: pieces) std::move(piece.begin(), piece.end(), std::back_inserter(out));
+        return out;
+    }
+} // namespace containers::detail
+
+#endif //TEXT_HPP
@@ -0,0 +1,28 @@
+#ifndef VARINT_HPP
+#define VARINT_HPP
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace containers::detail {
+    /* Variable-length integers (LEB128: 7 bits a byte, low bits first, high bit set on all but the last) */
+
+    inline void put_varint(std::string &out, uint64_t x) {
+        for (; x >= 0x80; x >>= 7) out.push_back(static_cast<char>((x & 0x7F) | 0x80));
+        out.push_back(static_cast<char>(x));
+    }
+
+    // reads the varint at p, moving p past it; throws if it runs past end
+    inline uint64_t get_varint(const char *&p, const char *end) {
+        uint64_t x = 0;
+        for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+            const auto byte = static_cast<unsigned char>(*p++);
+            x |= uint64_t{byte & 0x7Fu} << shift;
+            if (byte < 0x80) return x;
+        }
+        throw std::runtime_error("Corrupt varint");
+    }
+} // namespace containers::detail
+
+#endif //VARINT_HPP